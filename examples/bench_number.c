@@ -0,0 +1,118 @@
+/*
+ * Copyright 2016 Xiaomi Corporation. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ *
+ * Authors:    Yu Bo <yubo@xiaomi.com>
+ */
+
+/*
+ * Parse speed on number heavy payloads: arrays of small integers, 64-bit
+ * ids, prices and full precision doubles.
+ * usage: bench_number [count] [rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include "json.h"
+
+static uint64_t seed = 88172645463325252ULL;
+
+static uint64_t next(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return seed;
+}
+
+static int gen_int(char *buf)
+{
+	return sprintf(buf, "%d", (int)(next() % 100000) - 50000);
+}
+
+static int gen_id(char *buf)
+{
+	return sprintf(buf, "%" PRId64, (int64_t)(next() >> 1));
+}
+
+static int gen_price(char *buf)
+{
+	return sprintf(buf, "%d.%02d", (int)(next() % 100000),
+		       (int)(next() % 100));
+}
+
+static int gen_double(char *buf)
+{
+	return sprintf(buf, "%.17g", (double)(next() >> 11) / (1ULL << 53)
+		       * 1e6);
+}
+
+static char *payload(int (*gen)(char *), int count, size_t *len)
+{
+	char *buf = malloc((size_t)count * 32 + 2), *p = buf;
+	int i;
+
+	*p++ = '[';
+	for (i = 0; i < count; i++) {
+		if (i)
+			*p++ = ',';
+		p += gen(p);
+	}
+	*p++ = ']';
+	*p = 0;
+	*len = p - buf;
+	return buf;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	static const struct {
+		const char *name;
+		int (*gen)(char *);
+	} sets[] = {
+		{"ints", gen_int},
+		{"ids", gen_id},
+		{"prices", gen_price},
+		{"doubles", gen_double},
+	};
+	int count = argc > 1 ? atoi(argv[1]) : 100000;
+	int rounds = argc > 2 ? atoi(argv[2]) : 20;
+	struct json *root;
+	double t, sum;
+	size_t len;
+	char *buf;
+	int i, r;
+
+	for (i = 0; i < sizeof(sets) / sizeof(sets[0]); i++) {
+		buf = payload(sets[i].gen, count, &len);
+		sum = 0;
+		t = now();
+		for (r = 0; r < rounds; r++) {
+			if ((root = json_parse(buf)) == NULL) {
+				fprintf(stderr, "%s: parse error\n",
+					sets[i].name);
+				return 1;
+			}
+			sum += root->child->valuedouble;
+			json_delete(root);
+		}
+		t = now() - t;
+		printf("%-8s %8.1f MB/s %8.1f ns/number (%g)\n", sets[i].name,
+		       len * (double)rounds / t / 1e6,
+		       t * 1e9 / ((double)rounds * count), sum);
+		free(buf);
+	}
+	return 0;
+}
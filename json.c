@@ -29,9 +29,13 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
-#include <float.h>
 #include <limits.h>
 #include <ctype.h>
+#include <inttypes.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define JSON_SCAN_X86 1
+#endif
 #include "json.h"
 
 static int json_strcasecmp(const char *s1, const char *s2)
@@ -50,40 +54,422 @@ static int json_strcasecmp(const char *s1, const char *s2)
 void *(*json_malloc) (size_t sz) = malloc;
 void (*json_free) (void *ptr) = free;
 
-static char *json_strdup(const char *str)
+void json_init_hooks(struct json_hooks* hooks)
+{
+	if (!hooks) {		/* Reset hooks */
+		json_malloc = malloc;
+		json_free = free;
+		return;
+	}
+
+	json_malloc = (hooks->malloc_fn) ? hooks->malloc_fn : malloc;
+	json_free = (hooks->free_fn) ? hooks->free_fn : free;
+}
+
+/* Arena allocator */
+struct json_arena_block {
+	struct json_arena_block *next;
+	size_t size, used;
+	char data[];
+};
+
+/* Arena new nodes and node strings are allocated from, if any. */
+static __thread struct json_arena *json_bound_arena;
+
+void json_arena_init(struct json_arena *arena, size_t block_size)
+{
+	arena->block = 0;
+	arena->block_size = block_size ? block_size : JSON_ARENA_BLOCK_SIZE;
+}
+
+static struct json_arena_block *json_arena_new_block(size_t size)
+{
+	struct json_arena_block *b;
+
+	b = (struct json_arena_block *)
+	    json_malloc(sizeof(struct json_arena_block) + size);
+	if (!b)
+		return 0;
+	b->next = 0;
+	b->size = size;
+	b->used = 0;
+	return b;
+}
+
+void *json_arena_alloc(struct json_arena *arena, size_t sz)
+{
+	struct json_arena_block *b = arena->block;
+	void *ptr;
+
+	sz = (sz + 7) & ~(size_t)7;
+	if (b && b->size - b->used >= sz) {
+		ptr = b->data + b->used;
+		b->used += sz;
+		return ptr;
+	}
+
+	if (sz > arena->block_size / 4 && b) {
+		/* big chunks get a block of their own behind the current one,
+		 * so the current block keeps filling up */
+		if (!(b = json_arena_new_block(sz)))
+			return 0;
+		b->next = arena->block->next;
+		arena->block->next = b;
+	} else {
+		if (!(b = json_arena_new_block(sz > arena->block_size ?
+						sz : arena->block_size)))
+			return 0;
+		b->next = arena->block;
+		arena->block = b;
+	}
+	b->used = sz;
+	return b->data;
+}
+
+void json_arena_reset(struct json_arena *arena)
+{
+	struct json_arena_block *b, *next;
+
+	if (!(b = arena->block))
+		return;
+	for (next = b->next; next; next = b->next) {
+		b->next = next->next;
+		json_free(next);
+	}
+	if (b->size != arena->block_size) {
+		json_free(b);
+		arena->block = 0;
+		return;
+	}
+	b->used = 0;
+}
+
+void json_arena_destroy(struct json_arena *arena)
+{
+	json_arena_reset(arena);
+	if (arena->block)
+		json_free(arena->block);
+	arena->block = 0;
+}
+
+struct json_arena *json_arena_bind(struct json_arena *arena)
+{
+	struct json_arena *prev = json_bound_arena;
+
+	json_bound_arena = arena;
+	return prev;
+}
+
+/* Allocate memory that is owned by a node. */
+static void *json_item_alloc(size_t sz)
+{
+	if (json_bound_arena)
+		return json_arena_alloc(json_bound_arena, sz);
+	return json_malloc(sz);
+}
+
+static char *json_item_strdup(const char *str)
 {
 	size_t len;
 	char *copy;
 
 	len = strlen(str) + 1;
-	if (!(copy = (char *)json_malloc(len)))
+	if (!(copy = (char *)json_item_alloc(len)))
 		return 0;
 	memcpy(copy, str, len);
 	return copy;
 }
 
-void json_init_hooks(struct json_hooks* hooks)
+/* Replace the name of item, freeing the old one. */
+static void json_set_name(struct json *item, char *string)
 {
-	if (!hooks) {		/* Reset hooks */
-		json_malloc = malloc;
-		json_free = free;
+	if (item->string && !(item->flags & JSON_F_ARENA_NAME))
+		json_free(item->string);
+	item->string = string;
+	item->flags &= ~JSON_F_ARENA_NAME;
+	if (json_bound_arena)
+		item->flags |= JSON_F_ARENA_NAME;
+}
+
+static void json_set_valuestring(struct json *item, char *string)
+{
+	item->valuestring = string;
+	if (json_bound_arena)
+		item->flags |= JSON_F_ARENA_VALUE;
+}
+
+/* Child index of an array/object: the children in order, the last one is
+ * the tail new items are appended to.  It is an optimisation only, lists
+ * without one (or with a stale one) are walked and the index rebuilt.
+ * Objects with many members also hash them by (case folded) name, into
+ * hash_size slots that are set aside up front and filled in by the first
+ * lookup, which may come long after the members' names can be read. */
+struct json_index {
+	int count, size;
+	int hash_size;		/* a power of two, or 0 for no hash */
+	int hashed;		/* the slots are filled in and kept up to date */
+	struct json **hash;
+	struct json *items[];
+};
+
+/* Children before an array/object gets an index, members before an object
+ * gets a hash. */
+#define JSON_INDEX_MIN 8
+#define JSON_HASH_MIN 16
+
+/* The index of an arena item lives in the same arena (if one is bound). */
+static void *index_mem(struct json *item, size_t sz)
+{
+	if (item->flags & JSON_F_ARENA)
+		return json_bound_arena ? json_arena_alloc(json_bound_arena, sz)
+		    : 0;
+	return json_malloc(sz);
+}
+
+static void hash_free(struct json *item)
+{
+	struct json_index *idx = item->index;
+
+	if (idx->hash && !(item->flags & JSON_F_ARENA))
+		json_free(idx->hash);
+	idx->hash = 0;
+	idx->hash_size = idx->hashed = 0;
+}
+
+static void index_free(struct json *item)
+{
+	if (!item->index)
+		return;
+	hash_free(item);
+	if (!(item->flags & JSON_F_ARENA))
+		json_free(item->index);
+	item->index = 0;
+}
+
+/* Whether the index still matches the list, in case it was edited by hand. */
+static int index_valid(struct json *item)
+{
+	struct json_index *idx = item->index;
+	struct json *tail;
+
+	if (!idx)
+		return 0;
+	if (!idx->count)
+		return !item->child;
+	tail = idx->items[idx->count - 1];
+	return item->child == idx->items[0] && !tail->next
+	    && (tail == item->child || tail->prev->next == tail);
+}
+
+/* Make room in the index for n more children, building it if needed. */
+static int index_reserve(struct json *item, int n)
+{
+	struct json_index *idx;
+	struct json *c;
+	int count = 0, size = 8;
+
+	if (!index_valid(item))
+		index_free(item);
+	else if (item->index->size - item->index->count >= n)
+		return 0;
+
+	if (item->index) {
+		count = item->index->count;
+		size = item->index->size * 2;
+	} else
+		for (c = item->child; c; c = c->next)
+			count++;
+	while (size < count + n)
+		size *= 2;
+
+	idx = (struct json_index *)index_mem(item, sizeof(struct json_index) +
+					     size * sizeof(struct json *));
+	if (!idx)
+		return -1;
+	memset(idx, 0, sizeof(*idx));
+	if (item->index) {
+		memcpy(idx->items, item->index->items,
+		       count * sizeof(struct json *));
+		/* the hash stays */
+		idx->hash = item->index->hash;
+		idx->hash_size = item->index->hash_size;
+		idx->hashed = item->index->hashed;
+		item->index->hash = 0;
+	} else
+		for (count = 0, c = item->child; c; c = c->next)
+			idx->items[count++] = c;
+	idx->count = count;
+	idx->size = size;
+	index_free(item);
+	item->index = idx;
+	return 0;
+}
+
+/* What a lazy array/object (JSON_F_LAZY) keeps instead of its children:
+ * its text, and the arena to expand it into.  It is the item's valuestring,
+ * so it is released with the item; text follows it unless it was left in
+ * an insitu parser's buffer. */
+struct json_lazy {
+	char *text;
+	size_t len;
+	struct json_arena *arena;
+};
+
+/* The text of a JSON_T_RAW item, its valuestring.  Shared ones
+ * (JSON_F_SHARED) are counted and live on the heap. */
+struct json_raw {
+	int refs;
+	size_t len;
+	char text[];
+};
+
+/* Expand item before its children are looked at or changed. */
+static inline void json_touch(struct json *item)
+{
+	if (item->flags & JSON_F_LAZY)
+		json_expand(item);
+}
+
+static inline unsigned fold(unsigned char c)
+{
+	return c - 'A' < 26u ? c | 0x20 : c;
+}
+
+/* FNV-1a of the name, case folded so one hash serves both lookups. */
+static unsigned name_hash(const char *s)
+{
+	unsigned h = 2166136261u;
+
+	for (; *s; s++)
+		h = (h ^ fold(*s)) * 16777619u;
+	return h;
+}
+
+static int name_equal(const char *name, const char *string, int exact)
+{
+	if (!name)
+		return 0;
+	return exact ? !strcmp(name, string) : !json_strcasecmp(name, string);
+}
+
+/* Set aside (unfilled) slots for count members, at most half full. */
+static int hash_alloc(struct json *object, int count)
+{
+	struct json **hash;
+	int size = 32;
+
+	while (size < 2 * count)
+		size *= 2;
+	if (!(hash = (struct json **)index_mem(object, size * sizeof(*hash))))
+		return -1;
+	hash_free(object);
+	object->index->hash = hash;
+	object->index->hash_size = size;
+	return 0;
+}
+
+static void hash_insert(struct json_index *idx, struct json *c)
+{
+	unsigned mask = idx->hash_size - 1, i;
+
+	if (!c->string)
+		return;
+	for (i = name_hash(c->string) & mask; idx->hash[i]; i = (i + 1) & mask)
+		;
+	idx->hash[i] = c;
+}
+
+/* Linear probing, so the slots after c shift back to close the gap. */
+static void hash_remove(struct json_index *idx, struct json *c)
+{
+	unsigned mask = idx->hash_size - 1, i, j, k;
+
+	if (!c->string)
 		return;
+	for (i = name_hash(c->string) & mask; idx->hash[i] != c;
+	     i = (i + 1) & mask)
+		if (!idx->hash[i])
+			return;
+	for (j = i;;) {
+		j = (j + 1) & mask;
+		if (!idx->hash[j])
+			break;
+		k = name_hash(idx->hash[j]->string) & mask;
+		if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+			idx->hash[i] = idx->hash[j];
+			i = j;
+		}
 	}
+	idx->hash[i] = 0;
+}
 
-	json_malloc = (hooks->malloc_fn) ? hooks->malloc_fn : malloc;
-	json_free = (hooks->free_fn) ? hooks->free_fn : free;
+/* Fill in the slots, growing them first if the object has grown. */
+static int hash_fill(struct json *object)
+{
+	struct json_index *idx = object->index;
+	int i;
+
+	if (2 * idx->count > idx->hash_size && hash_alloc(object, idx->count))
+		return -1;
+	idx = object->index;
+	memset(idx->hash, 0, idx->hash_size * sizeof(*idx->hash));
+	for (i = 0; i < idx->count; i++)
+		hash_insert(idx, idx->items[i]);
+	idx->hashed = 1;
+	return 0;
+}
+
+/* Give object an index with slots for a hash, while memory for them can
+ * be had (an arena item's must come from its bound arena). */
+static void object_hash_init(struct json *object)
+{
+	if (!index_reserve(object, 0) && !object->index->hash_size)
+		hash_alloc(object, object->index->count);
+}
+
+static struct json *object_find(struct json *object, const char *string,
+				int exact)
+{
+	struct json_index *idx;
+	struct json *c;
+	unsigned mask, i;
+	int n = 0;
+
+	json_touch(object);	/* expanding brings the index along */
+	idx = object->index;
+	if (index_valid(object) && idx->hash_size &&
+	    (idx->hashed || !hash_fill(object))) {
+		idx = object->index;
+		mask = idx->hash_size - 1;
+		for (i = name_hash(string) & mask; (c = idx->hash[i]);
+		     i = (i + 1) & mask)
+			if (name_equal(c->string, string, exact))
+				return c;
+		return 0;
+	}
+	for (c = object->child; c && !name_equal(c->string, string, exact);
+	     c = c->next)
+		n++;
+	if (n >= JSON_HASH_MIN)
+		object_hash_init(object);	/* pays off from the next lookup */
+	return c;
 }
 
+
 /* Internal constructor. */
 static struct json *json_new_item()
 {
-	struct json *node = (struct json *) json_malloc(sizeof(struct json));
-	if (node)
+	struct json *node = (struct json *) json_item_alloc(sizeof(struct json));
+	if (node) {
 		memset(node, 0, sizeof(*node));
+		if (json_bound_arena)
+			node->flags = JSON_F_ARENA;
+	}
 	return node;
 }
 
-/* Delete a struct json structure. */
+/* Delete a struct json structure.  Whatever lives in an arena is left for
+ * json_arena_reset(). */
 void json_delete(struct json *c)
 {
 	struct json *next;
@@ -91,690 +477,2983 @@ void json_delete(struct json *c)
 		next = c->next;
 		if (!(c->type & JSON_T_IS_REFERENCE) && c->child)
 			json_delete(c->child);
-		if (!(c->type & JSON_T_IS_REFERENCE) && c->valuestring)
+		index_free(c);
+		if (c->type & JSON_T_IS_REFERENCE)
+			;
+		else if (c->flags & JSON_F_SHARED)
+			json_raw_put((struct json_raw *)c->valuestring);
+		else if (c->valuestring && !(c->flags & JSON_F_ARENA_VALUE))
 			json_free(c->valuestring);
-		if (c->string)
+		if (c->string && !(c->flags & JSON_F_ARENA_NAME))
 			json_free(c->string);
-		json_free(c);
+		if (!(c->flags & JSON_F_ARENA))
+			json_free(c);
 		c = next;
 	}
 }
 
-/* Parse the input text to generate a number, and populate the result into item. */
-static char **parse_number(struct json *item, char **num)
+/* The integer parts of an item's number, clamped to their range. */
+static int64_t double_to_int64(double d)
+{
+	if (d >= 0x1p63)
+		return INT64_MAX;
+	if (d < -0x1p63)
+		return INT64_MIN;
+	if (d != d)
+		return 0;
+	return (int64_t)d;
+}
+
+static void set_number(struct json *item, int64_t i, double d)
+{
+	item->type = JSON_T_NUMBER;
+	item->valuedouble = d;
+	item->valueint64 = i;
+	item->valueint = i > INT_MAX ? INT_MAX : i < INT_MIN ? INT_MIN : (int)i;
+}
+
+/*
+ * Decimal to double.  Numbers with up to 19 significant digits are w * 10^q
+ * with w a uint64_t.  If w < 2^53 and |q| <= 22 both factors are exact
+ * doubles and one multiplication or division rounds right (Clinger).  Any
+ * other such w is multiplied by 5^q truncated to 128 bits, which is always
+ * close enough to round right (Eisel-Lemire, as done by fast_float).
+ * Longer numbers are left to strtod().
+ */
+static const double pow10_exact[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define POW5_MIN -342
+#define POW5_MAX 308
+
+/* 5^q for q in [POW5_MIN, POW5_MAX], normalized and truncated (rounded up
+ * for q < 0) to 128 bits: high word, low word. */
+static const uint64_t pow5_128[] = {
+	0xeef453d6923bd65aULL, 0x113faa2906a13b3fULL,
+	0x9558b4661b6565f8ULL, 0x4ac7ca59a424c507ULL,
+	0xbaaee17fa23ebf76ULL, 0x5d79bcf00d2df649ULL,
+	0xe95a99df8ace6f53ULL, 0xf4d82c2c107973dcULL,
+	0x91d8a02bb6c10594ULL, 0x79071b9b8a4be869ULL,
+	0xb64ec836a47146f9ULL, 0x9748e2826cdee284ULL,
+	0xe3e27a444d8d98b7ULL, 0xfd1b1b2308169b25ULL,
+	0x8e6d8c6ab0787f72ULL, 0xfe30f0f5e50e20f7ULL,
+	0xb208ef855c969f4fULL, 0xbdbd2d335e51a935ULL,
+	0xde8b2b66b3bc4723ULL, 0xad2c788035e61382ULL,
+	0x8b16fb203055ac76ULL, 0x4c3bcb5021afcc31ULL,
+	0xaddcb9e83c6b1793ULL, 0xdf4abe242a1bbf3dULL,
+	0xd953e8624b85dd78ULL, 0xd71d6dad34a2af0dULL,
+	0x87d4713d6f33aa6bULL, 0x8672648c40e5ad68ULL,
+	0xa9c98d8ccb009506ULL, 0x680efdaf511f18c2ULL,
+	0xd43bf0effdc0ba48ULL, 0x0212bd1b2566def2ULL,
+	0x84a57695fe98746dULL, 0x014bb630f7604b57ULL,
+	0xa5ced43b7e3e9188ULL, 0x419ea3bd35385e2dULL,
+	0xcf42894a5dce35eaULL, 0x52064cac828675b9ULL,
+	0x818995ce7aa0e1b2ULL, 0x7343efebd1940993ULL,
+	0xa1ebfb4219491a1fULL, 0x1014ebe6c5f90bf8ULL,
+	0xca66fa129f9b60a6ULL, 0xd41a26e077774ef6ULL,
+	0xfd00b897478238d0ULL, 0x8920b098955522b4ULL,
+	0x9e20735e8cb16382ULL, 0x55b46e5f5d5535b0ULL,
+	0xc5a890362fddbc62ULL, 0xeb2189f734aa831dULL,
+	0xf712b443bbd52b7bULL, 0xa5e9ec7501d523e4ULL,
+	0x9a6bb0aa55653b2dULL, 0x47b233c92125366eULL,
+	0xc1069cd4eabe89f8ULL, 0x999ec0bb696e840aULL,
+	0xf148440a256e2c76ULL, 0xc00670ea43ca250dULL,
+	0x96cd2a865764dbcaULL, 0x380406926a5e5728ULL,
+	0xbc807527ed3e12bcULL, 0xc605083704f5ecf2ULL,
+	0xeba09271e88d976bULL, 0xf7864a44c633682eULL,
+	0x93445b8731587ea3ULL, 0x7ab3ee6afbe0211dULL,
+	0xb8157268fdae9e4cULL, 0x5960ea05bad82964ULL,
+	0xe61acf033d1a45dfULL, 0x6fb92487298e33bdULL,
+	0x8fd0c16206306babULL, 0xa5d3b6d479f8e056ULL,
+	0xb3c4f1ba87bc8696ULL, 0x8f48a4899877186cULL,
+	0xe0b62e2929aba83cULL, 0x331acdabfe94de87ULL,
+	0x8c71dcd9ba0b4925ULL, 0x9ff0c08b7f1d0b14ULL,
+	0xaf8e5410288e1b6fULL, 0x07ecf0ae5ee44dd9ULL,
+	0xdb71e91432b1a24aULL, 0xc9e82cd9f69d6150ULL,
+	0x892731ac9faf056eULL, 0xbe311c083a225cd2ULL,
+	0xab70fe17c79ac6caULL, 0x6dbd630a48aaf406ULL,
+	0xd64d3d9db981787dULL, 0x092cbbccdad5b108ULL,
+	0x85f0468293f0eb4eULL, 0x25bbf56008c58ea5ULL,
+	0xa76c582338ed2621ULL, 0xaf2af2b80af6f24eULL,
+	0xd1476e2c07286faaULL, 0x1af5af660db4aee1ULL,
+	0x82cca4db847945caULL, 0x50d98d9fc890ed4dULL,
+	0xa37fce126597973cULL, 0xe50ff107bab528a0ULL,
+	0xcc5fc196fefd7d0cULL, 0x1e53ed49a96272c8ULL,
+	0xff77b1fcbebcdc4fULL, 0x25e8e89c13bb0f7aULL,
+	0x9faacf3df73609b1ULL, 0x77b191618c54e9acULL,
+	0xc795830d75038c1dULL, 0xd59df5b9ef6a2417ULL,
+	0xf97ae3d0d2446f25ULL, 0x4b0573286b44ad1dULL,
+	0x9becce62836ac577ULL, 0x4ee367f9430aec32ULL,
+	0xc2e801fb244576d5ULL, 0x229c41f793cda73fULL,
+	0xf3a20279ed56d48aULL, 0x6b43527578c1110fULL,
+	0x9845418c345644d6ULL, 0x830a13896b78aaa9ULL,
+	0xbe5691ef416bd60cULL, 0x23cc986bc656d553ULL,
+	0xedec366b11c6cb8fULL, 0x2cbfbe86b7ec8aa8ULL,
+	0x94b3a202eb1c3f39ULL, 0x7bf7d71432f3d6a9ULL,
+	0xb9e08a83a5e34f07ULL, 0xdaf5ccd93fb0cc53ULL,
+	0xe858ad248f5c22c9ULL, 0xd1b3400f8f9cff68ULL,
+	0x91376c36d99995beULL, 0x23100809b9c21fa1ULL,
+	0xb58547448ffffb2dULL, 0xabd40a0c2832a78aULL,
+	0xe2e69915b3fff9f9ULL, 0x16c90c8f323f516cULL,
+	0x8dd01fad907ffc3bULL, 0xae3da7d97f6792e3ULL,
+	0xb1442798f49ffb4aULL, 0x99cd11cfdf41779cULL,
+	0xdd95317f31c7fa1dULL, 0x40405643d711d583ULL,
+	0x8a7d3eef7f1cfc52ULL, 0x482835ea666b2572ULL,
+	0xad1c8eab5ee43b66ULL, 0xda3243650005eecfULL,
+	0xd863b256369d4a40ULL, 0x90bed43e40076a82ULL,
+	0x873e4f75e2224e68ULL, 0x5a7744a6e804a291ULL,
+	0xa90de3535aaae202ULL, 0x711515d0a205cb36ULL,
+	0xd3515c2831559a83ULL, 0x0d5a5b44ca873e03ULL,
+	0x8412d9991ed58091ULL, 0xe858790afe9486c2ULL,
+	0xa5178fff668ae0b6ULL, 0x626e974dbe39a872ULL,
+	0xce5d73ff402d98e3ULL, 0xfb0a3d212dc8128fULL,
+	0x80fa687f881c7f8eULL, 0x7ce66634bc9d0b99ULL,
+	0xa139029f6a239f72ULL, 0x1c1fffc1ebc44e80ULL,
+	0xc987434744ac874eULL, 0xa327ffb266b56220ULL,
+	0xfbe9141915d7a922ULL, 0x4bf1ff9f0062baa8ULL,
+	0x9d71ac8fada6c9b5ULL, 0x6f773fc3603db4a9ULL,
+	0xc4ce17b399107c22ULL, 0xcb550fb4384d21d3ULL,
+	0xf6019da07f549b2bULL, 0x7e2a53a146606a48ULL,
+	0x99c102844f94e0fbULL, 0x2eda7444cbfc426dULL,
+	0xc0314325637a1939ULL, 0xfa911155fefb5308ULL,
+	0xf03d93eebc589f88ULL, 0x793555ab7eba27caULL,
+	0x96267c7535b763b5ULL, 0x4bc1558b2f3458deULL,
+	0xbbb01b9283253ca2ULL, 0x9eb1aaedfb016f16ULL,
+	0xea9c227723ee8bcbULL, 0x465e15a979c1cadcULL,
+	0x92a1958a7675175fULL, 0x0bfacd89ec191ec9ULL,
+	0xb749faed14125d36ULL, 0xcef980ec671f667bULL,
+	0xe51c79a85916f484ULL, 0x82b7e12780e7401aULL,
+	0x8f31cc0937ae58d2ULL, 0xd1b2ecb8b0908810ULL,
+	0xb2fe3f0b8599ef07ULL, 0x861fa7e6dcb4aa15ULL,
+	0xdfbdcece67006ac9ULL, 0x67a791e093e1d49aULL,
+	0x8bd6a141006042bdULL, 0xe0c8bb2c5c6d24e0ULL,
+	0xaecc49914078536dULL, 0x58fae9f773886e18ULL,
+	0xda7f5bf590966848ULL, 0xaf39a475506a899eULL,
+	0x888f99797a5e012dULL, 0x6d8406c952429603ULL,
+	0xaab37fd7d8f58178ULL, 0xc8e5087ba6d33b83ULL,
+	0xd5605fcdcf32e1d6ULL, 0xfb1e4a9a90880a64ULL,
+	0x855c3be0a17fcd26ULL, 0x5cf2eea09a55067fULL,
+	0xa6b34ad8c9dfc06fULL, 0xf42faa48c0ea481eULL,
+	0xd0601d8efc57b08bULL, 0xf13b94daf124da26ULL,
+	0x823c12795db6ce57ULL, 0x76c53d08d6b70858ULL,
+	0xa2cb1717b52481edULL, 0x54768c4b0c64ca6eULL,
+	0xcb7ddcdda26da268ULL, 0xa9942f5dcf7dfd09ULL,
+	0xfe5d54150b090b02ULL, 0xd3f93b35435d7c4cULL,
+	0x9efa548d26e5a6e1ULL, 0xc47bc5014a1a6dafULL,
+	0xc6b8e9b0709f109aULL, 0x359ab6419ca1091bULL,
+	0xf867241c8cc6d4c0ULL, 0xc30163d203c94b62ULL,
+	0x9b407691d7fc44f8ULL, 0x79e0de63425dcf1dULL,
+	0xc21094364dfb5636ULL, 0x985915fc12f542e4ULL,
+	0xf294b943e17a2bc4ULL, 0x3e6f5b7b17b2939dULL,
+	0x979cf3ca6cec5b5aULL, 0xa705992ceecf9c42ULL,
+	0xbd8430bd08277231ULL, 0x50c6ff782a838353ULL,
+	0xece53cec4a314ebdULL, 0xa4f8bf5635246428ULL,
+	0x940f4613ae5ed136ULL, 0x871b7795e136be99ULL,
+	0xb913179899f68584ULL, 0x28e2557b59846e3fULL,
+	0xe757dd7ec07426e5ULL, 0x331aeada2fe589cfULL,
+	0x9096ea6f3848984fULL, 0x3ff0d2c85def7621ULL,
+	0xb4bca50b065abe63ULL, 0x0fed077a756b53a9ULL,
+	0xe1ebce4dc7f16dfbULL, 0xd3e8495912c62894ULL,
+	0x8d3360f09cf6e4bdULL, 0x64712dd7abbbd95cULL,
+	0xb080392cc4349decULL, 0xbd8d794d96aacfb3ULL,
+	0xdca04777f541c567ULL, 0xecf0d7a0fc5583a0ULL,
+	0x89e42caaf9491b60ULL, 0xf41686c49db57244ULL,
+	0xac5d37d5b79b6239ULL, 0x311c2875c522ced5ULL,
+	0xd77485cb25823ac7ULL, 0x7d633293366b828bULL,
+	0x86a8d39ef77164bcULL, 0xae5dff9c02033197ULL,
+	0xa8530886b54dbdebULL, 0xd9f57f830283fdfcULL,
+	0xd267caa862a12d66ULL, 0xd072df63c324fd7bULL,
+	0x8380dea93da4bc60ULL, 0x4247cb9e59f71e6dULL,
+	0xa46116538d0deb78ULL, 0x52d9be85f074e608ULL,
+	0xcd795be870516656ULL, 0x67902e276c921f8bULL,
+	0x806bd9714632dff6ULL, 0x00ba1cd8a3db53b6ULL,
+	0xa086cfcd97bf97f3ULL, 0x80e8a40eccd228a4ULL,
+	0xc8a883c0fdaf7df0ULL, 0x6122cd128006b2cdULL,
+	0xfad2a4b13d1b5d6cULL, 0x796b805720085f81ULL,
+	0x9cc3a6eec6311a63ULL, 0xcbe3303674053bb0ULL,
+	0xc3f490aa77bd60fcULL, 0xbedbfc4411068a9cULL,
+	0xf4f1b4d515acb93bULL, 0xee92fb5515482d44ULL,
+	0x991711052d8bf3c5ULL, 0x751bdd152d4d1c4aULL,
+	0xbf5cd54678eef0b6ULL, 0xd262d45a78a0635dULL,
+	0xef340a98172aace4ULL, 0x86fb897116c87c34ULL,
+	0x9580869f0e7aac0eULL, 0xd45d35e6ae3d4da0ULL,
+	0xbae0a846d2195712ULL, 0x8974836059cca109ULL,
+	0xe998d258869facd7ULL, 0x2bd1a438703fc94bULL,
+	0x91ff83775423cc06ULL, 0x7b6306a34627ddcfULL,
+	0xb67f6455292cbf08ULL, 0x1a3bc84c17b1d542ULL,
+	0xe41f3d6a7377eecaULL, 0x20caba5f1d9e4a93ULL,
+	0x8e938662882af53eULL, 0x547eb47b7282ee9cULL,
+	0xb23867fb2a35b28dULL, 0xe99e619a4f23aa43ULL,
+	0xdec681f9f4c31f31ULL, 0x6405fa00e2ec94d4ULL,
+	0x8b3c113c38f9f37eULL, 0xde83bc408dd3dd04ULL,
+	0xae0b158b4738705eULL, 0x9624ab50b148d445ULL,
+	0xd98ddaee19068c76ULL, 0x3badd624dd9b0957ULL,
+	0x87f8a8d4cfa417c9ULL, 0xe54ca5d70a80e5d6ULL,
+	0xa9f6d30a038d1dbcULL, 0x5e9fcf4ccd211f4cULL,
+	0xd47487cc8470652bULL, 0x7647c3200069671fULL,
+	0x84c8d4dfd2c63f3bULL, 0x29ecd9f40041e073ULL,
+	0xa5fb0a17c777cf09ULL, 0xf468107100525890ULL,
+	0xcf79cc9db955c2ccULL, 0x7182148d4066eeb4ULL,
+	0x81ac1fe293d599bfULL, 0xc6f14cd848405530ULL,
+	0xa21727db38cb002fULL, 0xb8ada00e5a506a7cULL,
+	0xca9cf1d206fdc03bULL, 0xa6d90811f0e4851cULL,
+	0xfd442e4688bd304aULL, 0x908f4a166d1da663ULL,
+	0x9e4a9cec15763e2eULL, 0x9a598e4e043287feULL,
+	0xc5dd44271ad3cdbaULL, 0x40eff1e1853f29fdULL,
+	0xf7549530e188c128ULL, 0xd12bee59e68ef47cULL,
+	0x9a94dd3e8cf578b9ULL, 0x82bb74f8301958ceULL,
+	0xc13a148e3032d6e7ULL, 0xe36a52363c1faf01ULL,
+	0xf18899b1bc3f8ca1ULL, 0xdc44e6c3cb279ac1ULL,
+	0x96f5600f15a7b7e5ULL, 0x29ab103a5ef8c0b9ULL,
+	0xbcb2b812db11a5deULL, 0x7415d448f6b6f0e7ULL,
+	0xebdf661791d60f56ULL, 0x111b495b3464ad21ULL,
+	0x936b9fcebb25c995ULL, 0xcab10dd900beec34ULL,
+	0xb84687c269ef3bfbULL, 0x3d5d514f40eea742ULL,
+	0xe65829b3046b0afaULL, 0x0cb4a5a3112a5112ULL,
+	0x8ff71a0fe2c2e6dcULL, 0x47f0e785eaba72abULL,
+	0xb3f4e093db73a093ULL, 0x59ed216765690f56ULL,
+	0xe0f218b8d25088b8ULL, 0x306869c13ec3532cULL,
+	0x8c974f7383725573ULL, 0x1e414218c73a13fbULL,
+	0xafbd2350644eeacfULL, 0xe5d1929ef90898faULL,
+	0xdbac6c247d62a583ULL, 0xdf45f746b74abf39ULL,
+	0x894bc396ce5da772ULL, 0x6b8bba8c328eb783ULL,
+	0xab9eb47c81f5114fULL, 0x066ea92f3f326564ULL,
+	0xd686619ba27255a2ULL, 0xc80a537b0efefebdULL,
+	0x8613fd0145877585ULL, 0xbd06742ce95f5f36ULL,
+	0xa798fc4196e952e7ULL, 0x2c48113823b73704ULL,
+	0xd17f3b51fca3a7a0ULL, 0xf75a15862ca504c5ULL,
+	0x82ef85133de648c4ULL, 0x9a984d73dbe722fbULL,
+	0xa3ab66580d5fdaf5ULL, 0xc13e60d0d2e0ebbaULL,
+	0xcc963fee10b7d1b3ULL, 0x318df905079926a8ULL,
+	0xffbbcfe994e5c61fULL, 0xfdf17746497f7052ULL,
+	0x9fd561f1fd0f9bd3ULL, 0xfeb6ea8bedefa633ULL,
+	0xc7caba6e7c5382c8ULL, 0xfe64a52ee96b8fc0ULL,
+	0xf9bd690a1b68637bULL, 0x3dfdce7aa3c673b0ULL,
+	0x9c1661a651213e2dULL, 0x06bea10ca65c084eULL,
+	0xc31bfa0fe5698db8ULL, 0x486e494fcff30a62ULL,
+	0xf3e2f893dec3f126ULL, 0x5a89dba3c3efccfaULL,
+	0x986ddb5c6b3a76b7ULL, 0xf89629465a75e01cULL,
+	0xbe89523386091465ULL, 0xf6bbb397f1135823ULL,
+	0xee2ba6c0678b597fULL, 0x746aa07ded582e2cULL,
+	0x94db483840b717efULL, 0xa8c2a44eb4571cdcULL,
+	0xba121a4650e4ddebULL, 0x92f34d62616ce413ULL,
+	0xe896a0d7e51e1566ULL, 0x77b020baf9c81d17ULL,
+	0x915e2486ef32cd60ULL, 0x0ace1474dc1d122eULL,
+	0xb5b5ada8aaff80b8ULL, 0x0d819992132456baULL,
+	0xe3231912d5bf60e6ULL, 0x10e1fff697ed6c69ULL,
+	0x8df5efabc5979c8fULL, 0xca8d3ffa1ef463c1ULL,
+	0xb1736b96b6fd83b3ULL, 0xbd308ff8a6b17cb2ULL,
+	0xddd0467c64bce4a0ULL, 0xac7cb3f6d05ddbdeULL,
+	0x8aa22c0dbef60ee4ULL, 0x6bcdf07a423aa96bULL,
+	0xad4ab7112eb3929dULL, 0x86c16c98d2c953c6ULL,
+	0xd89d64d57a607744ULL, 0xe871c7bf077ba8b7ULL,
+	0x87625f056c7c4a8bULL, 0x11471cd764ad4972ULL,
+	0xa93af6c6c79b5d2dULL, 0xd598e40d3dd89bcfULL,
+	0xd389b47879823479ULL, 0x4aff1d108d4ec2c3ULL,
+	0x843610cb4bf160cbULL, 0xcedf722a585139baULL,
+	0xa54394fe1eedb8feULL, 0xc2974eb4ee658828ULL,
+	0xce947a3da6a9273eULL, 0x733d226229feea32ULL,
+	0x811ccc668829b887ULL, 0x0806357d5a3f525fULL,
+	0xa163ff802a3426a8ULL, 0xca07c2dcb0cf26f7ULL,
+	0xc9bcff6034c13052ULL, 0xfc89b393dd02f0b5ULL,
+	0xfc2c3f3841f17c67ULL, 0xbbac2078d443ace2ULL,
+	0x9d9ba7832936edc0ULL, 0xd54b944b84aa4c0dULL,
+	0xc5029163f384a931ULL, 0x0a9e795e65d4df11ULL,
+	0xf64335bcf065d37dULL, 0x4d4617b5ff4a16d5ULL,
+	0x99ea0196163fa42eULL, 0x504bced1bf8e4e45ULL,
+	0xc06481fb9bcf8d39ULL, 0xe45ec2862f71e1d6ULL,
+	0xf07da27a82c37088ULL, 0x5d767327bb4e5a4cULL,
+	0x964e858c91ba2655ULL, 0x3a6a07f8d510f86fULL,
+	0xbbe226efb628afeaULL, 0x890489f70a55368bULL,
+	0xeadab0aba3b2dbe5ULL, 0x2b45ac74ccea842eULL,
+	0x92c8ae6b464fc96fULL, 0x3b0b8bc90012929dULL,
+	0xb77ada0617e3bbcbULL, 0x09ce6ebb40173744ULL,
+	0xe55990879ddcaabdULL, 0xcc420a6a101d0515ULL,
+	0x8f57fa54c2a9eab6ULL, 0x9fa946824a12232dULL,
+	0xb32df8e9f3546564ULL, 0x47939822dc96abf9ULL,
+	0xdff9772470297ebdULL, 0x59787e2b93bc56f7ULL,
+	0x8bfbea76c619ef36ULL, 0x57eb4edb3c55b65aULL,
+	0xaefae51477a06b03ULL, 0xede622920b6b23f1ULL,
+	0xdab99e59958885c4ULL, 0xe95fab368e45ecedULL,
+	0x88b402f7fd75539bULL, 0x11dbcb0218ebb414ULL,
+	0xaae103b5fcd2a881ULL, 0xd652bdc29f26a119ULL,
+	0xd59944a37c0752a2ULL, 0x4be76d3346f0495fULL,
+	0x857fcae62d8493a5ULL, 0x6f70a4400c562ddbULL,
+	0xa6dfbd9fb8e5b88eULL, 0xcb4ccd500f6bb952ULL,
+	0xd097ad07a71f26b2ULL, 0x7e2000a41346a7a7ULL,
+	0x825ecc24c873782fULL, 0x8ed400668c0c28c8ULL,
+	0xa2f67f2dfa90563bULL, 0x728900802f0f32faULL,
+	0xcbb41ef979346bcaULL, 0x4f2b40a03ad2ffb9ULL,
+	0xfea126b7d78186bcULL, 0xe2f610c84987bfa8ULL,
+	0x9f24b832e6b0f436ULL, 0x0dd9ca7d2df4d7c9ULL,
+	0xc6ede63fa05d3143ULL, 0x91503d1c79720dbbULL,
+	0xf8a95fcf88747d94ULL, 0x75a44c6397ce912aULL,
+	0x9b69dbe1b548ce7cULL, 0xc986afbe3ee11abaULL,
+	0xc24452da229b021bULL, 0xfbe85badce996168ULL,
+	0xf2d56790ab41c2a2ULL, 0xfae27299423fb9c3ULL,
+	0x97c560ba6b0919a5ULL, 0xdccd879fc967d41aULL,
+	0xbdb6b8e905cb600fULL, 0x5400e987bbc1c920ULL,
+	0xed246723473e3813ULL, 0x290123e9aab23b68ULL,
+	0x9436c0760c86e30bULL, 0xf9a0b6720aaf6521ULL,
+	0xb94470938fa89bceULL, 0xf808e40e8d5b3e69ULL,
+	0xe7958cb87392c2c2ULL, 0xb60b1d1230b20e04ULL,
+	0x90bd77f3483bb9b9ULL, 0xb1c6f22b5e6f48c2ULL,
+	0xb4ecd5f01a4aa828ULL, 0x1e38aeb6360b1af3ULL,
+	0xe2280b6c20dd5232ULL, 0x25c6da63c38de1b0ULL,
+	0x8d590723948a535fULL, 0x579c487e5a38ad0eULL,
+	0xb0af48ec79ace837ULL, 0x2d835a9df0c6d851ULL,
+	0xdcdb1b2798182244ULL, 0xf8e431456cf88e65ULL,
+	0x8a08f0f8bf0f156bULL, 0x1b8e9ecb641b58ffULL,
+	0xac8b2d36eed2dac5ULL, 0xe272467e3d222f3fULL,
+	0xd7adf884aa879177ULL, 0x5b0ed81dcc6abb0fULL,
+	0x86ccbb52ea94baeaULL, 0x98e947129fc2b4e9ULL,
+	0xa87fea27a539e9a5ULL, 0x3f2398d747b36224ULL,
+	0xd29fe4b18e88640eULL, 0x8eec7f0d19a03aadULL,
+	0x83a3eeeef9153e89ULL, 0x1953cf68300424acULL,
+	0xa48ceaaab75a8e2bULL, 0x5fa8c3423c052dd7ULL,
+	0xcdb02555653131b6ULL, 0x3792f412cb06794dULL,
+	0x808e17555f3ebf11ULL, 0xe2bbd88bbee40bd0ULL,
+	0xa0b19d2ab70e6ed6ULL, 0x5b6aceaeae9d0ec4ULL,
+	0xc8de047564d20a8bULL, 0xf245825a5a445275ULL,
+	0xfb158592be068d2eULL, 0xeed6e2f0f0d56712ULL,
+	0x9ced737bb6c4183dULL, 0x55464dd69685606bULL,
+	0xc428d05aa4751e4cULL, 0xaa97e14c3c26b886ULL,
+	0xf53304714d9265dfULL, 0xd53dd99f4b3066a8ULL,
+	0x993fe2c6d07b7fabULL, 0xe546a8038efe4029ULL,
+	0xbf8fdb78849a5f96ULL, 0xde98520472bdd033ULL,
+	0xef73d256a5c0f77cULL, 0x963e66858f6d4440ULL,
+	0x95a8637627989aadULL, 0xdde7001379a44aa8ULL,
+	0xbb127c53b17ec159ULL, 0x5560c018580d5d52ULL,
+	0xe9d71b689dde71afULL, 0xaab8f01e6e10b4a6ULL,
+	0x9226712162ab070dULL, 0xcab3961304ca70e8ULL,
+	0xb6b00d69bb55c8d1ULL, 0x3d607b97c5fd0d22ULL,
+	0xe45c10c42a2b3b05ULL, 0x8cb89a7db77c506aULL,
+	0x8eb98a7a9a5b04e3ULL, 0x77f3608e92adb242ULL,
+	0xb267ed1940f1c61cULL, 0x55f038b237591ed3ULL,
+	0xdf01e85f912e37a3ULL, 0x6b6c46dec52f6688ULL,
+	0x8b61313bbabce2c6ULL, 0x2323ac4b3b3da015ULL,
+	0xae397d8aa96c1b77ULL, 0xabec975e0a0d081aULL,
+	0xd9c7dced53c72255ULL, 0x96e7bd358c904a21ULL,
+	0x881cea14545c7575ULL, 0x7e50d64177da2e54ULL,
+	0xaa242499697392d2ULL, 0xdde50bd1d5d0b9e9ULL,
+	0xd4ad2dbfc3d07787ULL, 0x955e4ec64b44e864ULL,
+	0x84ec3c97da624ab4ULL, 0xbd5af13bef0b113eULL,
+	0xa6274bbdd0fadd61ULL, 0xecb1ad8aeacdd58eULL,
+	0xcfb11ead453994baULL, 0x67de18eda5814af2ULL,
+	0x81ceb32c4b43fcf4ULL, 0x80eacf948770ced7ULL,
+	0xa2425ff75e14fc31ULL, 0xa1258379a94d028dULL,
+	0xcad2f7f5359a3b3eULL, 0x096ee45813a04330ULL,
+	0xfd87b5f28300ca0dULL, 0x8bca9d6e188853fcULL,
+	0x9e74d1b791e07e48ULL, 0x775ea264cf55347eULL,
+	0xc612062576589ddaULL, 0x95364afe032a819eULL,
+	0xf79687aed3eec551ULL, 0x3a83ddbd83f52205ULL,
+	0x9abe14cd44753b52ULL, 0xc4926a9672793543ULL,
+	0xc16d9a0095928a27ULL, 0x75b7053c0f178294ULL,
+	0xf1c90080baf72cb1ULL, 0x5324c68b12dd6339ULL,
+	0x971da05074da7beeULL, 0xd3f6fc16ebca5e04ULL,
+	0xbce5086492111aeaULL, 0x88f4bb1ca6bcf585ULL,
+	0xec1e4a7db69561a5ULL, 0x2b31e9e3d06c32e6ULL,
+	0x9392ee8e921d5d07ULL, 0x3aff322e62439fd0ULL,
+	0xb877aa3236a4b449ULL, 0x09befeb9fad487c3ULL,
+	0xe69594bec44de15bULL, 0x4c2ebe687989a9b4ULL,
+	0x901d7cf73ab0acd9ULL, 0x0f9d37014bf60a11ULL,
+	0xb424dc35095cd80fULL, 0x538484c19ef38c95ULL,
+	0xe12e13424bb40e13ULL, 0x2865a5f206b06fbaULL,
+	0x8cbccc096f5088cbULL, 0xf93f87b7442e45d4ULL,
+	0xafebff0bcb24aafeULL, 0xf78f69a51539d749ULL,
+	0xdbe6fecebdedd5beULL, 0xb573440e5a884d1cULL,
+	0x89705f4136b4a597ULL, 0x31680a88f8953031ULL,
+	0xabcc77118461cefcULL, 0xfdc20d2b36ba7c3eULL,
+	0xd6bf94d5e57a42bcULL, 0x3d32907604691b4dULL,
+	0x8637bd05af6c69b5ULL, 0xa63f9a49c2c1b110ULL,
+	0xa7c5ac471b478423ULL, 0x0fcf80dc33721d54ULL,
+	0xd1b71758e219652bULL, 0xd3c36113404ea4a9ULL,
+	0x83126e978d4fdf3bULL, 0x645a1cac083126eaULL,
+	0xa3d70a3d70a3d70aULL, 0x3d70a3d70a3d70a4ULL,
+	0xccccccccccccccccULL, 0xcccccccccccccccdULL,
+	0x8000000000000000ULL, 0x0000000000000000ULL,
+	0xa000000000000000ULL, 0x0000000000000000ULL,
+	0xc800000000000000ULL, 0x0000000000000000ULL,
+	0xfa00000000000000ULL, 0x0000000000000000ULL,
+	0x9c40000000000000ULL, 0x0000000000000000ULL,
+	0xc350000000000000ULL, 0x0000000000000000ULL,
+	0xf424000000000000ULL, 0x0000000000000000ULL,
+	0x9896800000000000ULL, 0x0000000000000000ULL,
+	0xbebc200000000000ULL, 0x0000000000000000ULL,
+	0xee6b280000000000ULL, 0x0000000000000000ULL,
+	0x9502f90000000000ULL, 0x0000000000000000ULL,
+	0xba43b74000000000ULL, 0x0000000000000000ULL,
+	0xe8d4a51000000000ULL, 0x0000000000000000ULL,
+	0x9184e72a00000000ULL, 0x0000000000000000ULL,
+	0xb5e620f480000000ULL, 0x0000000000000000ULL,
+	0xe35fa931a0000000ULL, 0x0000000000000000ULL,
+	0x8e1bc9bf04000000ULL, 0x0000000000000000ULL,
+	0xb1a2bc2ec5000000ULL, 0x0000000000000000ULL,
+	0xde0b6b3a76400000ULL, 0x0000000000000000ULL,
+	0x8ac7230489e80000ULL, 0x0000000000000000ULL,
+	0xad78ebc5ac620000ULL, 0x0000000000000000ULL,
+	0xd8d726b7177a8000ULL, 0x0000000000000000ULL,
+	0x878678326eac9000ULL, 0x0000000000000000ULL,
+	0xa968163f0a57b400ULL, 0x0000000000000000ULL,
+	0xd3c21bcecceda100ULL, 0x0000000000000000ULL,
+	0x84595161401484a0ULL, 0x0000000000000000ULL,
+	0xa56fa5b99019a5c8ULL, 0x0000000000000000ULL,
+	0xcecb8f27f4200f3aULL, 0x0000000000000000ULL,
+	0x813f3978f8940984ULL, 0x4000000000000000ULL,
+	0xa18f07d736b90be5ULL, 0x5000000000000000ULL,
+	0xc9f2c9cd04674edeULL, 0xa400000000000000ULL,
+	0xfc6f7c4045812296ULL, 0x4d00000000000000ULL,
+	0x9dc5ada82b70b59dULL, 0xf020000000000000ULL,
+	0xc5371912364ce305ULL, 0x6c28000000000000ULL,
+	0xf684df56c3e01bc6ULL, 0xc732000000000000ULL,
+	0x9a130b963a6c115cULL, 0x3c7f400000000000ULL,
+	0xc097ce7bc90715b3ULL, 0x4b9f100000000000ULL,
+	0xf0bdc21abb48db20ULL, 0x1e86d40000000000ULL,
+	0x96769950b50d88f4ULL, 0x1314448000000000ULL,
+	0xbc143fa4e250eb31ULL, 0x17d955a000000000ULL,
+	0xeb194f8e1ae525fdULL, 0x5dcfab0800000000ULL,
+	0x92efd1b8d0cf37beULL, 0x5aa1cae500000000ULL,
+	0xb7abc627050305adULL, 0xf14a3d9e40000000ULL,
+	0xe596b7b0c643c719ULL, 0x6d9ccd05d0000000ULL,
+	0x8f7e32ce7bea5c6fULL, 0xe4820023a2000000ULL,
+	0xb35dbf821ae4f38bULL, 0xdda2802c8a800000ULL,
+	0xe0352f62a19e306eULL, 0xd50b2037ad200000ULL,
+	0x8c213d9da502de45ULL, 0x4526f422cc340000ULL,
+	0xaf298d050e4395d6ULL, 0x9670b12b7f410000ULL,
+	0xdaf3f04651d47b4cULL, 0x3c0cdd765f114000ULL,
+	0x88d8762bf324cd0fULL, 0xa5880a69fb6ac800ULL,
+	0xab0e93b6efee0053ULL, 0x8eea0d047a457a00ULL,
+	0xd5d238a4abe98068ULL, 0x72a4904598d6d880ULL,
+	0x85a36366eb71f041ULL, 0x47a6da2b7f864750ULL,
+	0xa70c3c40a64e6c51ULL, 0x999090b65f67d924ULL,
+	0xd0cf4b50cfe20765ULL, 0xfff4b4e3f741cf6dULL,
+	0x82818f1281ed449fULL, 0xbff8f10e7a8921a4ULL,
+	0xa321f2d7226895c7ULL, 0xaff72d52192b6a0dULL,
+	0xcbea6f8ceb02bb39ULL, 0x9bf4f8a69f764490ULL,
+	0xfee50b7025c36a08ULL, 0x02f236d04753d5b4ULL,
+	0x9f4f2726179a2245ULL, 0x01d762422c946590ULL,
+	0xc722f0ef9d80aad6ULL, 0x424d3ad2b7b97ef5ULL,
+	0xf8ebad2b84e0d58bULL, 0xd2e0898765a7deb2ULL,
+	0x9b934c3b330c8577ULL, 0x63cc55f49f88eb2fULL,
+	0xc2781f49ffcfa6d5ULL, 0x3cbf6b71c76b25fbULL,
+	0xf316271c7fc3908aULL, 0x8bef464e3945ef7aULL,
+	0x97edd871cfda3a56ULL, 0x97758bf0e3cbb5acULL,
+	0xbde94e8e43d0c8ecULL, 0x3d52eeed1cbea317ULL,
+	0xed63a231d4c4fb27ULL, 0x4ca7aaa863ee4bddULL,
+	0x945e455f24fb1cf8ULL, 0x8fe8caa93e74ef6aULL,
+	0xb975d6b6ee39e436ULL, 0xb3e2fd538e122b44ULL,
+	0xe7d34c64a9c85d44ULL, 0x60dbbca87196b616ULL,
+	0x90e40fbeea1d3a4aULL, 0xbc8955e946fe31cdULL,
+	0xb51d13aea4a488ddULL, 0x6babab6398bdbe41ULL,
+	0xe264589a4dcdab14ULL, 0xc696963c7eed2dd1ULL,
+	0x8d7eb76070a08aecULL, 0xfc1e1de5cf543ca2ULL,
+	0xb0de65388cc8ada8ULL, 0x3b25a55f43294bcbULL,
+	0xdd15fe86affad912ULL, 0x49ef0eb713f39ebeULL,
+	0x8a2dbf142dfcc7abULL, 0x6e3569326c784337ULL,
+	0xacb92ed9397bf996ULL, 0x49c2c37f07965404ULL,
+	0xd7e77a8f87daf7fbULL, 0xdc33745ec97be906ULL,
+	0x86f0ac99b4e8dafdULL, 0x69a028bb3ded71a3ULL,
+	0xa8acd7c0222311bcULL, 0xc40832ea0d68ce0cULL,
+	0xd2d80db02aabd62bULL, 0xf50a3fa490c30190ULL,
+	0x83c7088e1aab65dbULL, 0x792667c6da79e0faULL,
+	0xa4b8cab1a1563f52ULL, 0x577001b891185938ULL,
+	0xcde6fd5e09abcf26ULL, 0xed4c0226b55e6f86ULL,
+	0x80b05e5ac60b6178ULL, 0x544f8158315b05b4ULL,
+	0xa0dc75f1778e39d6ULL, 0x696361ae3db1c721ULL,
+	0xc913936dd571c84cULL, 0x03bc3a19cd1e38e9ULL,
+	0xfb5878494ace3a5fULL, 0x04ab48a04065c723ULL,
+	0x9d174b2dcec0e47bULL, 0x62eb0d64283f9c76ULL,
+	0xc45d1df942711d9aULL, 0x3ba5d0bd324f8394ULL,
+	0xf5746577930d6500ULL, 0xca8f44ec7ee36479ULL,
+	0x9968bf6abbe85f20ULL, 0x7e998b13cf4e1ecbULL,
+	0xbfc2ef456ae276e8ULL, 0x9e3fedd8c321a67eULL,
+	0xefb3ab16c59b14a2ULL, 0xc5cfe94ef3ea101eULL,
+	0x95d04aee3b80ece5ULL, 0xbba1f1d158724a12ULL,
+	0xbb445da9ca61281fULL, 0x2a8a6e45ae8edc97ULL,
+	0xea1575143cf97226ULL, 0xf52d09d71a3293bdULL,
+	0x924d692ca61be758ULL, 0x593c2626705f9c56ULL,
+	0xb6e0c377cfa2e12eULL, 0x6f8b2fb00c77836cULL,
+	0xe498f455c38b997aULL, 0x0b6dfb9c0f956447ULL,
+	0x8edf98b59a373fecULL, 0x4724bd4189bd5eacULL,
+	0xb2977ee300c50fe7ULL, 0x58edec91ec2cb657ULL,
+	0xdf3d5e9bc0f653e1ULL, 0x2f2967b66737e3edULL,
+	0x8b865b215899f46cULL, 0xbd79e0d20082ee74ULL,
+	0xae67f1e9aec07187ULL, 0xecd8590680a3aa11ULL,
+	0xda01ee641a708de9ULL, 0xe80e6f4820cc9495ULL,
+	0x884134fe908658b2ULL, 0x3109058d147fdcddULL,
+	0xaa51823e34a7eedeULL, 0xbd4b46f0599fd415ULL,
+	0xd4e5e2cdc1d1ea96ULL, 0x6c9e18ac7007c91aULL,
+	0x850fadc09923329eULL, 0x03e2cf6bc604ddb0ULL,
+	0xa6539930bf6bff45ULL, 0x84db8346b786151cULL,
+	0xcfe87f7cef46ff16ULL, 0xe612641865679a63ULL,
+	0x81f14fae158c5f6eULL, 0x4fcb7e8f3f60c07eULL,
+	0xa26da3999aef7749ULL, 0xe3be5e330f38f09dULL,
+	0xcb090c8001ab551cULL, 0x5cadf5bfd3072cc5ULL,
+	0xfdcb4fa002162a63ULL, 0x73d9732fc7c8f7f6ULL,
+	0x9e9f11c4014dda7eULL, 0x2867e7fddcdd9afaULL,
+	0xc646d63501a1511dULL, 0xb281e1fd541501b8ULL,
+	0xf7d88bc24209a565ULL, 0x1f225a7ca91a4226ULL,
+	0x9ae757596946075fULL, 0x3375788de9b06958ULL,
+	0xc1a12d2fc3978937ULL, 0x0052d6b1641c83aeULL,
+	0xf209787bb47d6b84ULL, 0xc0678c5dbd23a49aULL,
+	0x9745eb4d50ce6332ULL, 0xf840b7ba963646e0ULL,
+	0xbd176620a501fbffULL, 0xb650e5a93bc3d898ULL,
+	0xec5d3fa8ce427affULL, 0xa3e51f138ab4cebeULL,
+	0x93ba47c980e98cdfULL, 0xc66f336c36b10137ULL,
+	0xb8a8d9bbe123f017ULL, 0xb80b0047445d4184ULL,
+	0xe6d3102ad96cec1dULL, 0xa60dc059157491e5ULL,
+	0x9043ea1ac7e41392ULL, 0x87c89837ad68db2fULL,
+	0xb454e4a179dd1877ULL, 0x29babe4598c311fbULL,
+	0xe16a1dc9d8545e94ULL, 0xf4296dd6fef3d67aULL,
+	0x8ce2529e2734bb1dULL, 0x1899e4a65f58660cULL,
+	0xb01ae745b101e9e4ULL, 0x5ec05dcff72e7f8fULL,
+	0xdc21a1171d42645dULL, 0x76707543f4fa1f73ULL,
+	0x899504ae72497ebaULL, 0x6a06494a791c53a8ULL,
+	0xabfa45da0edbde69ULL, 0x0487db9d17636892ULL,
+	0xd6f8d7509292d603ULL, 0x45a9d2845d3c42b6ULL,
+	0x865b86925b9bc5c2ULL, 0x0b8a2392ba45a9b2ULL,
+	0xa7f26836f282b732ULL, 0x8e6cac7768d7141eULL,
+	0xd1ef0244af2364ffULL, 0x3207d795430cd926ULL,
+	0x8335616aed761f1fULL, 0x7f44e6bd49e807b8ULL,
+	0xa402b9c5a8d3a6e7ULL, 0x5f16206c9c6209a6ULL,
+	0xcd036837130890a1ULL, 0x36dba887c37a8c0fULL,
+	0x802221226be55a64ULL, 0xc2494954da2c9789ULL,
+	0xa02aa96b06deb0fdULL, 0xf2db9baa10b7bd6cULL,
+	0xc83553c5c8965d3dULL, 0x6f92829494e5acc7ULL,
+	0xfa42a8b73abbf48cULL, 0xcb772339ba1f17f9ULL,
+	0x9c69a97284b578d7ULL, 0xff2a760414536efbULL,
+	0xc38413cf25e2d70dULL, 0xfef5138519684abaULL,
+	0xf46518c2ef5b8cd1ULL, 0x7eb258665fc25d69ULL,
+	0x98bf2f79d5993802ULL, 0xef2f773ffbd97a61ULL,
+	0xbeeefb584aff8603ULL, 0xaafb550ffacfd8faULL,
+	0xeeaaba2e5dbf6784ULL, 0x95ba2a53f983cf38ULL,
+	0x952ab45cfa97a0b2ULL, 0xdd945a747bf26183ULL,
+	0xba756174393d88dfULL, 0x94f971119aeef9e4ULL,
+	0xe912b9d1478ceb17ULL, 0x7a37cd5601aab85dULL,
+	0x91abb422ccb812eeULL, 0xac62e055c10ab33aULL,
+	0xb616a12b7fe617aaULL, 0x577b986b314d6009ULL,
+	0xe39c49765fdf9d94ULL, 0xed5a7e85fda0b80bULL,
+	0x8e41ade9fbebc27dULL, 0x14588f13be847307ULL,
+	0xb1d219647ae6b31cULL, 0x596eb2d8ae258fc8ULL,
+	0xde469fbd99a05fe3ULL, 0x6fca5f8ed9aef3bbULL,
+	0x8aec23d680043beeULL, 0x25de7bb9480d5854ULL,
+	0xada72ccc20054ae9ULL, 0xaf561aa79a10ae6aULL,
+	0xd910f7ff28069da4ULL, 0x1b2ba1518094da04ULL,
+	0x87aa9aff79042286ULL, 0x90fb44d2f05d0842ULL,
+	0xa99541bf57452b28ULL, 0x353a1607ac744a53ULL,
+	0xd3fa922f2d1675f2ULL, 0x42889b8997915ce8ULL,
+	0x847c9b5d7c2e09b7ULL, 0x69956135febada11ULL,
+	0xa59bc234db398c25ULL, 0x43fab9837e699095ULL,
+	0xcf02b2c21207ef2eULL, 0x94f967e45e03f4bbULL,
+	0x8161afb94b44f57dULL, 0x1d1be0eebac278f5ULL,
+	0xa1ba1ba79e1632dcULL, 0x6462d92a69731732ULL,
+	0xca28a291859bbf93ULL, 0x7d7b8f7503cfdcfeULL,
+	0xfcb2cb35e702af78ULL, 0x5cda735244c3d43eULL,
+	0x9defbf01b061adabULL, 0x3a0888136afa64a7ULL,
+	0xc56baec21c7a1916ULL, 0x088aaa1845b8fdd0ULL,
+	0xf6c69a72a3989f5bULL, 0x8aad549e57273d45ULL,
+	0x9a3c2087a63f6399ULL, 0x36ac54e2f678864bULL,
+	0xc0cb28a98fcf3c7fULL, 0x84576a1bb416a7ddULL,
+	0xf0fdf2d3f3c30b9fULL, 0x656d44a2a11c51d5ULL,
+	0x969eb7c47859e743ULL, 0x9f644ae5a4b1b325ULL,
+	0xbc4665b596706114ULL, 0x873d5d9f0dde1feeULL,
+	0xeb57ff22fc0c7959ULL, 0xa90cb506d155a7eaULL,
+	0x9316ff75dd87cbd8ULL, 0x09a7f12442d588f2ULL,
+	0xb7dcbf5354e9beceULL, 0x0c11ed6d538aeb2fULL,
+	0xe5d3ef282a242e81ULL, 0x8f1668c8a86da5faULL,
+	0x8fa475791a569d10ULL, 0xf96e017d694487bcULL,
+	0xb38d92d760ec4455ULL, 0x37c981dcc395a9acULL,
+	0xe070f78d3927556aULL, 0x85bbe253f47b1417ULL,
+	0x8c469ab843b89562ULL, 0x93956d7478ccec8eULL,
+	0xaf58416654a6babbULL, 0x387ac8d1970027b2ULL,
+	0xdb2e51bfe9d0696aULL, 0x06997b05fcc0319eULL,
+	0x88fcf317f22241e2ULL, 0x441fece3bdf81f03ULL,
+	0xab3c2fddeeaad25aULL, 0xd527e81cad7626c3ULL,
+	0xd60b3bd56a5586f1ULL, 0x8a71e223d8d3b074ULL,
+	0x85c7056562757456ULL, 0xf6872d5667844e49ULL,
+	0xa738c6bebb12d16cULL, 0xb428f8ac016561dbULL,
+	0xd106f86e69d785c7ULL, 0xe13336d701beba52ULL,
+	0x82a45b450226b39cULL, 0xecc0024661173473ULL,
+	0xa34d721642b06084ULL, 0x27f002d7f95d0190ULL,
+	0xcc20ce9bd35c78a5ULL, 0x31ec038df7b441f4ULL,
+	0xff290242c83396ceULL, 0x7e67047175a15271ULL,
+	0x9f79a169bd203e41ULL, 0x0f0062c6e984d386ULL,
+	0xc75809c42c684dd1ULL, 0x52c07b78a3e60868ULL,
+	0xf92e0c3537826145ULL, 0xa7709a56ccdf8a82ULL,
+	0x9bbcc7a142b17ccbULL, 0x88a66076400bb691ULL,
+	0xc2abf989935ddbfeULL, 0x6acff893d00ea435ULL,
+	0xf356f7ebf83552feULL, 0x0583f6b8c4124d43ULL,
+	0x98165af37b2153deULL, 0xc3727a337a8b704aULL,
+	0xbe1bf1b059e9a8d6ULL, 0x744f18c0592e4c5cULL,
+	0xeda2ee1c7064130cULL, 0x1162def06f79df73ULL,
+	0x9485d4d1c63e8be7ULL, 0x8addcb5645ac2ba8ULL,
+	0xb9a74a0637ce2ee1ULL, 0x6d953e2bd7173692ULL,
+	0xe8111c87c5c1ba99ULL, 0xc8fa8db6ccdd0437ULL,
+	0x910ab1d4db9914a0ULL, 0x1d9c9892400a22a2ULL,
+	0xb54d5e4a127f59c8ULL, 0x2503beb6d00cab4bULL,
+	0xe2a0b5dc971f303aULL, 0x2e44ae64840fd61dULL,
+	0x8da471a9de737e24ULL, 0x5ceaecfed289e5d2ULL,
+	0xb10d8e1456105dadULL, 0x7425a83e872c5f47ULL,
+	0xdd50f1996b947518ULL, 0xd12f124e28f77719ULL,
+	0x8a5296ffe33cc92fULL, 0x82bd6b70d99aaa6fULL,
+	0xace73cbfdc0bfb7bULL, 0x636cc64d1001550bULL,
+	0xd8210befd30efa5aULL, 0x3c47f7e05401aa4eULL,
+	0x8714a775e3e95c78ULL, 0x65acfaec34810a71ULL,
+	0xa8d9d1535ce3b396ULL, 0x7f1839a741a14d0dULL,
+	0xd31045a8341ca07cULL, 0x1ede48111209a050ULL,
+	0x83ea2b892091e44dULL, 0x934aed0aab460432ULL,
+	0xa4e4b66b68b65d60ULL, 0xf81da84d5617853fULL,
+	0xce1de40642e3f4b9ULL, 0x36251260ab9d668eULL,
+	0x80d2ae83e9ce78f3ULL, 0xc1d72b7c6b426019ULL,
+	0xa1075a24e4421730ULL, 0xb24cf65b8612f81fULL,
+	0xc94930ae1d529cfcULL, 0xdee033f26797b627ULL,
+	0xfb9b7cd9a4a7443cULL, 0x169840ef017da3b1ULL,
+	0x9d412e0806e88aa5ULL, 0x8e1f289560ee864eULL,
+	0xc491798a08a2ad4eULL, 0xf1a6f2bab92a27e2ULL,
+	0xf5b5d7ec8acb58a2ULL, 0xae10af696774b1dbULL,
+	0x9991a6f3d6bf1765ULL, 0xacca6da1e0a8ef29ULL,
+	0xbff610b0cc6edd3fULL, 0x17fd090a58d32af3ULL,
+	0xeff394dcff8a948eULL, 0xddfc4b4cef07f5b0ULL,
+	0x95f83d0a1fb69cd9ULL, 0x4abdaf101564f98eULL,
+	0xbb764c4ca7a4440fULL, 0x9d6d1ad41abe37f1ULL,
+	0xea53df5fd18d5513ULL, 0x84c86189216dc5edULL,
+	0x92746b9be2f8552cULL, 0x32fd3cf5b4e49bb4ULL,
+	0xb7118682dbb66a77ULL, 0x3fbc8c33221dc2a1ULL,
+	0xe4d5e82392a40515ULL, 0x0fabaf3feaa5334aULL,
+	0x8f05b1163ba6832dULL, 0x29cb4d87f2a7400eULL,
+	0xb2c71d5bca9023f8ULL, 0x743e20e9ef511012ULL,
+	0xdf78e4b2bd342cf6ULL, 0x914da9246b255416ULL,
+	0x8bab8eefb6409c1aULL, 0x1ad089b6c2f7548eULL,
+	0xae9672aba3d0c320ULL, 0xa184ac2473b529b1ULL,
+	0xda3c0f568cc4f3e8ULL, 0xc9e5d72d90a2741eULL,
+	0x8865899617fb1871ULL, 0x7e2fa67c7a658892ULL,
+	0xaa7eebfb9df9de8dULL, 0xddbb901b98feeab7ULL,
+	0xd51ea6fa85785631ULL, 0x552a74227f3ea565ULL,
+	0x8533285c936b35deULL, 0xd53a88958f87275fULL,
+	0xa67ff273b8460356ULL, 0x8a892abaf368f137ULL,
+	0xd01fef10a657842cULL, 0x2d2b7569b0432d85ULL,
+	0x8213f56a67f6b29bULL, 0x9c3b29620e29fc73ULL,
+	0xa298f2c501f45f42ULL, 0x8349f3ba91b47b8fULL,
+	0xcb3f2f7642717713ULL, 0x241c70a936219a73ULL,
+	0xfe0efb53d30dd4d7ULL, 0xed238cd383aa0110ULL,
+	0x9ec95d1463e8a506ULL, 0xf4363804324a40aaULL,
+	0xc67bb4597ce2ce48ULL, 0xb143c6053edcd0d5ULL,
+	0xf81aa16fdc1b81daULL, 0xdd94b7868e94050aULL,
+	0x9b10a4e5e9913128ULL, 0xca7cf2b4191c8326ULL,
+	0xc1d4ce1f63f57d72ULL, 0xfd1c2f611f63a3f0ULL,
+	0xf24a01a73cf2dccfULL, 0xbc633b39673c8cecULL,
+	0x976e41088617ca01ULL, 0xd5be0503e085d813ULL,
+	0xbd49d14aa79dbc82ULL, 0x4b2d8644d8a74e18ULL,
+	0xec9c459d51852ba2ULL, 0xddf8e7d60ed1219eULL,
+	0x93e1ab8252f33b45ULL, 0xcabb90e5c942b503ULL,
+	0xb8da1662e7b00a17ULL, 0x3d6a751f3b936243ULL,
+	0xe7109bfba19c0c9dULL, 0x0cc512670a783ad4ULL,
+	0x906a617d450187e2ULL, 0x27fb2b80668b24c5ULL,
+	0xb484f9dc9641e9daULL, 0xb1f9f660802dedf6ULL,
+	0xe1a63853bbd26451ULL, 0x5e7873f8a0396973ULL,
+	0x8d07e33455637eb2ULL, 0xdb0b487b6423e1e8ULL,
+	0xb049dc016abc5e5fULL, 0x91ce1a9a3d2cda62ULL,
+	0xdc5c5301c56b75f7ULL, 0x7641a140cc7810fbULL,
+	0x89b9b3e11b6329baULL, 0xa9e904c87fcb0a9dULL,
+	0xac2820d9623bf429ULL, 0x546345fa9fbdcd44ULL,
+	0xd732290fbacaf133ULL, 0xa97c177947ad4095ULL,
+	0x867f59a9d4bed6c0ULL, 0x49ed8eabcccc485dULL,
+	0xa81f301449ee8c70ULL, 0x5c68f256bfff5a74ULL,
+	0xd226fc195c6a2f8cULL, 0x73832eec6fff3111ULL,
+	0x83585d8fd9c25db7ULL, 0xc831fd53c5ff7eabULL,
+	0xa42e74f3d032f525ULL, 0xba3e7ca8b77f5e55ULL,
+	0xcd3a1230c43fb26fULL, 0x28ce1bd2e55f35ebULL,
+	0x80444b5e7aa7cf85ULL, 0x7980d163cf5b81b3ULL,
+	0xa0555e361951c366ULL, 0xd7e105bcc332621fULL,
+	0xc86ab5c39fa63440ULL, 0x8dd9472bf3fefaa7ULL,
+	0xfa856334878fc150ULL, 0xb14f98f6f0feb951ULL,
+	0x9c935e00d4b9d8d2ULL, 0x6ed1bf9a569f33d3ULL,
+	0xc3b8358109e84f07ULL, 0x0a862f80ec4700c8ULL,
+	0xf4a642e14c6262c8ULL, 0xcd27bb612758c0faULL,
+	0x98e7e9cccfbd7dbdULL, 0x8038d51cb897789cULL,
+	0xbf21e44003acdd2cULL, 0xe0470a63e6bd56c3ULL,
+	0xeeea5d5004981478ULL, 0x1858ccfce06cac74ULL,
+	0x95527a5202df0ccbULL, 0x0f37801e0c43ebc8ULL,
+	0xbaa718e68396cffdULL, 0xd30560258f54e6baULL,
+	0xe950df20247c83fdULL, 0x47c6b82ef32a2069ULL,
+	0x91d28b7416cdd27eULL, 0x4cdc331d57fa5441ULL,
+	0xb6472e511c81471dULL, 0xe0133fe4adf8e952ULL,
+	0xe3d8f9e563a198e5ULL, 0x58180fddd97723a6ULL,
+	0x8e679c2f5e44ff8fULL, 0x570f09eaa7ea7648ULL,
+};
+
+/* a * b, returns the low 64 bits and puts the high ones in *high. */
+static inline uint64_t mul_128(uint64_t a, uint64_t b, uint64_t *high)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 r = (unsigned __int128)a * b;
+
+	*high = (uint64_t)(r >> 64);
+	return (uint64_t)r;
+#else
+	uint64_t al = (uint32_t)a, ah = a >> 32, bl = (uint32_t)b, bh = b >> 32;
+	uint64_t ll = al * bl, lh = al * bh, hl = ah * bl, hh = ah * bh;
+	uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+
+	*high = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+	return (mid << 32) | (uint32_t)ll;
+#endif
+}
+
+static double eisel_lemire(uint64_t w, int q, int neg)
+{
+	uint64_t high, low, high2, mantissa, bits;
+	int lz, upper, power2, index;
+	double d;
+
+	if (!w || q < POW5_MIN)
+		bits = 0;
+	else if (q > POW5_MAX)
+		bits = 0x7ffULL << 52;
+	else {
+		lz = __builtin_clzll(w);
+		w <<= lz;
+		index = 2 * (q - POW5_MIN);
+		low = mul_128(w, pow5_128[index], &high);
+		if ((high & 0x1ff) == 0x1ff) {
+			/* the truncation may matter, take 64 more bits */
+			mul_128(w, pow5_128[index + 1], &high2);
+			low += high2;
+			if (high2 > low)
+				high++;
+		}
+		upper = high >> 63;
+		mantissa = high >> (upper + 9);
+		power2 = (((152170 + 65536) * q) >> 16) + 63 + upper - lz + 1023;
+		if (power2 <= 0) {
+			/* subnormal */
+			if (-power2 + 1 >= 64)
+				mantissa = power2 = 0;
+			else {
+				mantissa >>= -power2 + 1;
+				mantissa += mantissa & 1;
+				mantissa >>= 1;
+				power2 = mantissa < (1ULL << 52) ? 0 : 1;
+			}
+			bits = mantissa | (uint64_t)power2 << 52;
+		} else {
+			/* exactly halfway: round to even */
+			if (low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1
+			    && (mantissa << (upper + 9)) == high)
+				mantissa &= ~1ULL;
+			mantissa += mantissa & 1;
+			mantissa >>= 1;
+			if (mantissa >= (2ULL << 52)) {
+				mantissa = 1ULL << 52;
+				power2++;
+			}
+			mantissa &= ~(1ULL << 52);
+			if (power2 >= 0x7ff) {
+				power2 = 0x7ff;
+				mantissa = 0;
+			}
+			bits = mantissa | (uint64_t)power2 << 52;
+		}
+	}
+	if (neg)
+		bits |= 1ULL << 63;
+	memcpy(&d, &bits, sizeof(d));
+	return d;
+}
+
+static double parse_long_number(const char *num, size_t len)
+{
+	char tmp[64], *str = tmp;
+	double d;
+
+	if (len >= sizeof(tmp) && !(str = (char *)json_malloc(len + 1)))
+		return 0;
+	memcpy(str, num, len);
+	str[len] = 0;
+	d = strtod(str, NULL);
+	if (str != tmp)
+		json_free(str);
+	return d;
+}
+
+static inline int is_digit(char c)
 {
-	double n = 0, sign = 1, scale = 0;
-	int subscale = 0, signsubscale = 1;
+	return c >= '0' && c <= '9';
+}
 
-	if (**num == '-') {	/* Has sign? */
-		sign = -1;
-		(*num)++;
+/* Parse the number token num[0..len), and populate the result into item.
+ * Returns the number of bytes consumed, 0 if it isn't a number. */
+static size_t parse_number(struct json *item, const char *num, size_t len)
+{
+	uint64_t w = 0;
+	int neg = 0, digits = 0, q = 0, e = 0, eneg = 0;
+	int integral = 1, inexact = 0;
+	size_t i = 0, first;
+	double d;
+
+	if (i < len && num[i] == '-') {	/* Has sign? */
+		neg = 1;
+		i++;
 	}
-	if (**num == '0')	/* is zero */
-		(*num)++;
-	if (**num >= '1' && **num <= '9') {	/* Number? */
-		do {
-			n = (n * 10.0) + (**num - '0');
-			(*num)++;
-		} while (**num >= '0' && **num <= '9');
+	first = i;
+	if (i < len && num[i] == '0')	/* is zero */
+		i++;
+	for (; i < len && is_digit(num[i]); i++) {	/* Number? */
+		if (digits < 19) {
+			w = w * 10 + (num[i] - '0');
+			digits += w != 0;
+		} else {
+			q++;
+			inexact |= num[i] != '0';
+		}
 	}
-	if (**num == '.' && (*num)[1] >= '0' && (*num)[1] <= '9') {	/* Fractional part? */
-		(*num)++;
-		do {
-			n = (n * 10.0) + (**num - '0');
-			scale--;
-			(*num)++;
-		} while (**num >= '0' && **num <= '9');
+	if (i == first)
+		return 0;
+	if (i + 1 < len && num[i] == '.' && is_digit(num[i + 1])) {	/* Fractional part? */
+		integral = 0;
+		for (i++; i < len && is_digit(num[i]); i++) {
+			if (digits < 19) {
+				w = w * 10 + (num[i] - '0');
+				digits += w != 0;
+				q--;
+			} else
+				inexact |= num[i] != '0';
+		}
 	}
-	if (**num == 'e' || **num == 'E') {	/* Exponent? */
-		(*num)++;
+	if (i < len && (num[i] == 'e' || num[i] == 'E')) {	/* Exponent? */
+		integral = 0;
+		i++;
 		/* signed? */
-		if (**num == '+')
-			(*num)++;
-		else if (**num == '-') {
-			signsubscale = -1;
-			(*num)++;
+		if (i < len && num[i] == '+')
+			i++;
+		else if (i < len && num[i] == '-') {
+			eneg = 1;
+			i++;
+		}
+		for (; i < len && is_digit(num[i]); i++)
+			if (e < 100000)
+				e = e * 10 + (num[i] - '0');
+	}
+	q += eneg ? -e : e;
+
+	if (integral && !q && !inexact && w <= (uint64_t)INT64_MAX + neg) {
+		/* exact, and the conversion to double rounds right */
+		set_number(item, neg ? (int64_t)(0 - w) : (int64_t)w,
+			   neg ? -(double)w : (double)w);
+		return i;
+	}
+	if (inexact)
+		d = parse_long_number(num, i);
+	else if (w <= 1ULL << 53 && q >= -22 && q <= 22) {
+		d = q < 0 ? (double)w / pow10_exact[-q] : (double)w * pow10_exact[q];
+		if (neg)
+			d = -d;
+	} else
+		d = eisel_lemire(w, q, neg);
+	set_number(item, double_to_int64(d), d);
+	return i;
+}
+
+/* Make room for n more bytes (and the terminating NUL) in the output. */
+static int buffer_reserve(struct json_buffer *b, size_t n)
+{
+	char *data;
+	size_t size;
+
+	if (b->size - b->len > n)
+		return 0;
+	if (b->fixed)
+		return -1;
+	size = b->size ? b->size : 256;
+	while (size - b->len <= n)
+		size *= 2;
+	if (!(data = (char *)json_malloc(size)))
+		return -1;
+	if (b->data) {
+		memcpy(data, b->data, b->len);
+		json_free(b->data);
+	}
+	b->data = data;
+	b->size = size;
+	return 0;
+}
+
+static int buffer_append(struct json_buffer *b, const char *str, size_t n)
+{
+	if (buffer_reserve(b, n))
+		return -1;
+	memcpy(b->data + b->len, str, n);
+	b->len += n;
+	return 0;
+}
+
+static int buffer_fill(struct json_buffer *b, char c, size_t n)
+{
+	if (buffer_reserve(b, n))
+		return -1;
+	memset(b->data + b->len, c, n);
+	b->len += n;
+	return 0;
+}
+
+/* Render the number nicely from the given item into the buffer. */
+static const char digit_pairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233"
+	"34353637383940414243444546474849505152535455565758596061626364656667"
+	"6869707172737475767778798081828384858687888990919293949596979899";
+
+static int count_digits(uint64_t v)
+{
+	int n = 1;
+
+	for (; v >= 10000; v /= 10000)
+		n += 4;
+	return n + (v >= 10) + (v >= 100) + (v >= 1000);
+}
+
+/* Write the n digits of v so they end at end, two at a time. */
+static void format_digits(char *end, uint64_t v)
+{
+	for (; v >= 100; v /= 100) {
+		end -= 2;
+		memcpy(end, digit_pairs + 2 * (v % 100), 2);
+	}
+	if (v >= 10)
+		memcpy(end - 2, digit_pairs + 2 * v, 2);
+	else
+		end[-1] = '0' + v;
+}
+
+static int print_int64(int64_t i, struct json_buffer *b)
+{
+	uint64_t v = i < 0 ? 0 - (uint64_t)i : (uint64_t)i;
+	int n = count_digits(v) + (i < 0);
+
+	if (buffer_reserve(b, n))
+		return -1;
+	if (i < 0)
+		b->data[b->len] = '-';
+	b->len += n;
+	format_digits(b->data + b->len, v);
+	return 0;
+}
+
+/*
+ * Double to shortest decimal, Grisu2 (Loitsch, "Printing Floating-Point
+ * Numbers Quickly and Accurately with Integers", as done by RapidJSON).
+ * The output always reads back as the same double, and is the shortest
+ * such in all but a few rare cases, where it is a digit longer.
+ * A diy_fp is f * 2^e.
+ */
+struct diy_fp {
+	uint64_t f;
+	int e;
+};
+
+/* 10^k for k = -348, -340, ..., 340, normalized to 64 bits. */
+static const struct diy_fp cached_powers[] = {
+	{0xfa8fd5a0081c0288ULL, -1220},
+	{0xbaaee17fa23ebf76ULL, -1193},
+	{0x8b16fb203055ac76ULL, -1166},
+	{0xcf42894a5dce35eaULL, -1140},
+	{0x9a6bb0aa55653b2dULL, -1113},
+	{0xe61acf033d1a45dfULL, -1087},
+	{0xab70fe17c79ac6caULL, -1060},
+	{0xff77b1fcbebcdc4fULL, -1034},
+	{0xbe5691ef416bd60cULL, -1007},
+	{0x8dd01fad907ffc3cULL, -980},
+	{0xd3515c2831559a83ULL, -954},
+	{0x9d71ac8fada6c9b5ULL, -927},
+	{0xea9c227723ee8bcbULL, -901},
+	{0xaecc49914078536dULL, -874},
+	{0x823c12795db6ce57ULL, -847},
+	{0xc21094364dfb5637ULL, -821},
+	{0x9096ea6f3848984fULL, -794},
+	{0xd77485cb25823ac7ULL, -768},
+	{0xa086cfcd97bf97f4ULL, -741},
+	{0xef340a98172aace5ULL, -715},
+	{0xb23867fb2a35b28eULL, -688},
+	{0x84c8d4dfd2c63f3bULL, -661},
+	{0xc5dd44271ad3cdbaULL, -635},
+	{0x936b9fcebb25c996ULL, -608},
+	{0xdbac6c247d62a584ULL, -582},
+	{0xa3ab66580d5fdaf6ULL, -555},
+	{0xf3e2f893dec3f126ULL, -529},
+	{0xb5b5ada8aaff80b8ULL, -502},
+	{0x87625f056c7c4a8bULL, -475},
+	{0xc9bcff6034c13053ULL, -449},
+	{0x964e858c91ba2655ULL, -422},
+	{0xdff9772470297ebdULL, -396},
+	{0xa6dfbd9fb8e5b88fULL, -369},
+	{0xf8a95fcf88747d94ULL, -343},
+	{0xb94470938fa89bcfULL, -316},
+	{0x8a08f0f8bf0f156bULL, -289},
+	{0xcdb02555653131b6ULL, -263},
+	{0x993fe2c6d07b7facULL, -236},
+	{0xe45c10c42a2b3b06ULL, -210},
+	{0xaa242499697392d3ULL, -183},
+	{0xfd87b5f28300ca0eULL, -157},
+	{0xbce5086492111aebULL, -130},
+	{0x8cbccc096f5088ccULL, -103},
+	{0xd1b71758e219652cULL, -77},
+	{0x9c40000000000000ULL, -50},
+	{0xe8d4a51000000000ULL, -24},
+	{0xad78ebc5ac620000ULL, 3},
+	{0x813f3978f8940984ULL, 30},
+	{0xc097ce7bc90715b3ULL, 56},
+	{0x8f7e32ce7bea5c70ULL, 83},
+	{0xd5d238a4abe98068ULL, 109},
+	{0x9f4f2726179a2245ULL, 136},
+	{0xed63a231d4c4fb27ULL, 162},
+	{0xb0de65388cc8ada8ULL, 189},
+	{0x83c7088e1aab65dbULL, 216},
+	{0xc45d1df942711d9aULL, 242},
+	{0x924d692ca61be758ULL, 269},
+	{0xda01ee641a708deaULL, 295},
+	{0xa26da3999aef774aULL, 322},
+	{0xf209787bb47d6b85ULL, 348},
+	{0xb454e4a179dd1877ULL, 375},
+	{0x865b86925b9bc5c2ULL, 402},
+	{0xc83553c5c8965d3dULL, 428},
+	{0x952ab45cfa97a0b3ULL, 455},
+	{0xde469fbd99a05fe3ULL, 481},
+	{0xa59bc234db398c25ULL, 508},
+	{0xf6c69a72a3989f5cULL, 534},
+	{0xb7dcbf5354e9beceULL, 561},
+	{0x88fcf317f22241e2ULL, 588},
+	{0xcc20ce9bd35c78a5ULL, 614},
+	{0x98165af37b2153dfULL, 641},
+	{0xe2a0b5dc971f303aULL, 667},
+	{0xa8d9d1535ce3b396ULL, 694},
+	{0xfb9b7cd9a4a7443cULL, 720},
+	{0xbb764c4ca7a44410ULL, 747},
+	{0x8bab8eefb6409c1aULL, 774},
+	{0xd01fef10a657842cULL, 800},
+	{0x9b10a4e5e9913129ULL, 827},
+	{0xe7109bfba19c0c9dULL, 853},
+	{0xac2820d9623bf429ULL, 880},
+	{0x80444b5e7aa7cf85ULL, 907},
+	{0xbf21e44003acdd2dULL, 933},
+	{0x8e679c2f5e44ff8fULL, 960},
+	{0xd433179d9c8cb841ULL, 986},
+	{0x9e19db92b4e31ba9ULL, 1013},
+	{0xeb96bf6ebadf77d9ULL, 1039},
+	{0xaf87023b9bf0ee6bULL, 1066},
+};
+
+static struct diy_fp diy_mul(struct diy_fp a, struct diy_fp b)
+{
+	struct diy_fp r;
+	uint64_t low = mul_128(a.f, b.f, &r.f);
+
+	r.f += low >> 63;	/* round */
+	r.e = a.e + b.e + 64;
+	return r;
+}
+
+static struct diy_fp diy_normalize(struct diy_fp a)
+{
+	int s = __builtin_clzll(a.f);
+
+	a.f <<= s;
+	a.e -= s;
+	return a;
+}
+
+static void grisu_round(char *buf, int len, uint64_t delta, uint64_t rest,
+			uint64_t ten_kappa, uint64_t wp_w)
+{
+	while (rest < wp_w && delta - rest >= ten_kappa &&
+	       (rest + ten_kappa < wp_w ||
+		wp_w - rest > rest + ten_kappa - wp_w)) {
+		buf[len - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+static const uint64_t pow10_u64[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL,
+	10000000000000000000ULL
+};
+
+/* Generate the digits of w within delta of the upper bound mp. */
+static int grisu_digits(struct diy_fp w, struct diy_fp mp, uint64_t delta,
+			char *buf, int *k)
+{
+	uint64_t one = 1ULL << -mp.e, wp_w = mp.f - w.f;
+	uint32_t p1 = (uint32_t)(mp.f >> -mp.e), d;
+	uint64_t p2 = mp.f & (one - 1), rest;
+	int kappa = count_digits(p1), len = 0;
+
+	while (kappa > 0) {
+		d = p1 / pow10_u64[kappa - 1];
+		p1 %= pow10_u64[kappa - 1];
+		if (d || len)
+			buf[len++] = '0' + d;
+		kappa--;
+		rest = ((uint64_t)p1 << -mp.e) + p2;
+		if (rest <= delta) {
+			*k += kappa;
+			grisu_round(buf, len, delta, rest,
+				    pow10_u64[kappa] << -mp.e, wp_w);
+			return len;
 		}
-		while (**num >= '0' && **num <= '9') {	/* Number? */
-			subscale = (subscale * 10) + (**num - '0');
-			(*num)++;
+	}
+	for (;;) {
+		p2 *= 10;
+		delta *= 10;
+		d = (uint32_t)(p2 >> -mp.e);
+		if (d || len)
+			buf[len++] = '0' + d;
+		p2 &= one - 1;
+		kappa--;
+		if (p2 < delta) {
+			*k += kappa;
+			grisu_round(buf, len, delta, p2, one,
+				    wp_w * (-kappa < 20 ? pow10_u64[-kappa] : 0));
+			return len;
 		}
 	}
+}
+
+/* The digits of finite d > 0 into buf, d = buf * 10^k.  Returns their
+ * number, at most 17. */
+static int grisu2(double d, char *buf, int *k)
+{
+	struct diy_fp v, w, mp, mm, c;
+	uint64_t bits;
+	int be, ck, i;
+
+	memcpy(&bits, &d, sizeof(bits));
+	be = (bits >> 52) & 0x7ff;
+	v.f = bits & ((1ULL << 52) - 1);
+	if (be) {
+		v.f += 1ULL << 52;
+		v.e = be - 1075;
+	} else
+		v.e = -1074;
+
+	/* the boundaries halfway to the neighbouring doubles */
+	mp.f = (v.f << 1) + 1;
+	mp.e = v.e - 1;
+	mp = diy_normalize(mp);
+	if (v.f == 1ULL << 52) {
+		mm.f = (v.f << 2) - 1;
+		mm.e = v.e - 2;
+	} else {
+		mm.f = (v.f << 1) - 1;
+		mm.e = v.e - 1;
+	}
+	mm.f <<= mm.e - mp.e;
+	mm.e = mp.e;
+
+	/* scale by a cached 10^-ck so the exponent lands in [-60, -32] */
+	ck = (int)ceil((-61 - mp.e) * 0.30102999566398114) + 347;
+	i = (ck >> 3) + 1;
+	*k = -(-348 + i * 8);
+	c = cached_powers[i];
+
+	w = diy_mul(diy_normalize(v), c);
+	mp = diy_mul(mp, c);
+	mm = diy_mul(mm, c);
+	mm.f++;
+	mp.f--;
+	return grisu_digits(w, mp, mp.f - mm.f, buf, k);
+}
 
-	n = sign * n * pow(10.0, (scale + subscale * signsubscale));	/* number = +/- number.fraction * 10^+/- exponent */
+/* Lay out the digits buf[0..len) * 10^k like %g would, in place, and
+ * return the new length.  buf must have room for len + 8 or so. */
+static int format_decimal(char *buf, int len, int k)
+{
+	int kk = len + k, e;	/* 10^(kk-1) <= v < 10^kk */
 
-	item->valuedouble = n;
-	item->valueint = (int)n;
-	item->type = JSON_T_NUMBER;
-	return num;
+	if (k >= 0 && kk <= 21) {
+		/* 1234e7 -> 12340000000 */
+		memset(buf + len, '0', k);
+		return kk;
+	}
+	if (kk > 0 && kk <= 21) {
+		/* 1234e-2 -> 12.34 */
+		memmove(buf + kk + 1, buf + kk, len - kk);
+		buf[kk] = '.';
+		return len + 1;
+	}
+	if (kk > -6 && kk <= 0) {
+		/* 1234e-6 -> 0.001234 */
+		memmove(buf + 2 - kk, buf, len);
+		buf[0] = '0';
+		buf[1] = '.';
+		memset(buf + 2, '0', -kk);
+		return len + 2 - kk;
+	}
+	/* 1234e30 -> 1.234e33 */
+	if (len > 1) {
+		memmove(buf + 2, buf + 1, len - 1);
+		buf[1] = '.';
+		len++;
+	}
+	buf[len++] = 'e';
+	e = kk - 1;
+	if (e < 0) {
+		buf[len++] = '-';
+		e = -e;
+	}
+	k = count_digits(e);
+	len += k;
+	format_digits(buf + len, e);
+	return len;
 }
 
-/* Render the number nicely from the given item into a string. */
-static char *print_number(struct json *item)
+static int print_double(double d, struct json_buffer *b)
+{
+	char str[32], *p = str;
+	int len, k;
+
+	if (d != d || d - d != 0)
+		return buffer_append(b, "null", 4);	/* no NaN/Inf in JSON */
+	if (d < 0) {
+		*p++ = '-';
+		d = -d;
+	}
+	if (d == 0)
+		*p++ = '0';
+	else {
+		len = grisu2(d, p, &k);
+		p += format_decimal(p, len, k);
+	}
+	return buffer_append(b, str, p - str);
+}
+
+static int print_number(struct json *item, struct json_buffer *b)
 {
-	char *str;
 	double d = item->valuedouble;
-	if (fabs(((double)item->valueint) - d) <= DBL_EPSILON && d <= INT_MAX
-	    && d >= INT_MIN) {
-		str = (char *)json_malloc(21);	/* 2^64+1 can be represented in 21 chars. */
-		if (str)
-			sprintf(str, "%d", item->valueint);
-	} else {
-		str = (char *)json_malloc(64);	/* This is a nice tradeoff. */
-		if (str) {
-			if (fabs(floor(d) - d) <= DBL_EPSILON)
-				sprintf(str, "%.0f", d);
-			else if (fabs(d) < 1.0e-6 || fabs(d) > 1.0e9)
-				sprintf(str, "%e", d);
-			else
-				sprintf(str, "%f", d);
-		}
+
+	/* 2^63 itself comes out as INT64_MAX, which reads back the same */
+	if (d == (double)item->valueint64 && d <= 0x1p63 && d >= -0x1p63)
+		return print_int64(item->valueint64, b);
+	return print_double(d, b);
+}
+
+/* Read the four hex digits of a \u escape. */
+static int parse_hex4(const char *str, unsigned *out)
+{
+	unsigned uc = 0;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		uc <<= 4;
+		if (str[i] >= '0' && str[i] <= '9')
+			uc |= str[i] - '0';
+		else if (str[i] >= 'a' && str[i] <= 'f')
+			uc |= str[i] - 'a' + 10;
+		else if (str[i] >= 'A' && str[i] <= 'F')
+			uc |= str[i] - 'A' + 10;
+		else
+			return -1;
 	}
-	return str;
+	*out = uc;
+	return 0;
 }
 
-/* Parse the input text into an unescaped cstring, and populate item. */
+/* Unescape the body of a string token, str[0..len) (without the quotes),
+ * into out and return the length written.  The output never gets ahead of
+ * the input, so out may be str itself. */
 static const unsigned char firstByteMark[7] =
     { 0x00, 0x00, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC };
-static char **parse_string(struct json *item, char **str)
+static size_t unescape_string(char *out, const char *str, size_t len)
 {
-	char *ptr = *str + 1;
+	const char *ptr = str, *end = str + len;
 	char *ptr2;
-	char *out;
-	int len = 0;
 	unsigned uc, uc2;
-	if (**str != '\"')
-		return NULL;	/* not a string! */
-
-	while (*ptr != '\"' && *ptr && ++len)
-		if (*ptr++ == '\\')
-			ptr++;	/* Skip escaped quotes. */
-
-	out = (char *)json_malloc(len + 1);	/* This is how long we need for the string, roughly. */
-	if (!out)
-		return 0;
+	int n;
 
-	ptr = *str + 1;
 	ptr2 = out;
-	while (*ptr != '\"' && *ptr) {
-		if (*ptr != '\\')
+	while (ptr < end) {
+		if (*ptr != '\\') {
 			*ptr2++ = *ptr++;
-		else {
-			ptr++;
-			switch (*ptr) {
-			case 'b':
-				*ptr2++ = '\b';
-				break;
-			case 'f':
-				*ptr2++ = '\f';
-				break;
-			case 'n':
-				*ptr2++ = '\n';
-				break;
-			case 'r':
-				*ptr2++ = '\r';
-				break;
-			case 't':
-				*ptr2++ = '\t';
-				break;
-			case 'u':	/* transcode utf16 to utf8. */
-				sscanf(ptr + 1, "%4x", &uc);
-				ptr += 4;	/* get the unicode char. */
-
-				if ((uc >= 0xDC00 && uc <= 0xDFFF) || uc == 0)
-					break;	// check for invalid.
-
-				if (uc >= 0xD800 && uc <= 0xDBFF)	// UTF16 surrogate pairs.
-				{
-					if (ptr[1] != '\\' || ptr[2] != 'u')
-						break;	// missing second-half of surrogate.
-					sscanf(ptr + 3, "%4x", &uc2);
-					ptr += 6;
-					if (uc2 < 0xDC00 || uc2 > 0xDFFF)
-						break;	// invalid second-half of surrogate.
-					uc = 0x10000 | ((uc & 0x3FF) << 10) |
-					    (uc2 & 0x3FF);
-				}
+			continue;
+		}
+		if (++ptr == end)
+			break;
+		switch (*ptr) {
+		case 'b':
+			*ptr2++ = '\b';
+			break;
+		case 'f':
+			*ptr2++ = '\f';
+			break;
+		case 'n':
+			*ptr2++ = '\n';
+			break;
+		case 'r':
+			*ptr2++ = '\r';
+			break;
+		case 't':
+			*ptr2++ = '\t';
+			break;
+		case 'u':	/* transcode utf16 to utf8. */
+			if (end - ptr < 5 || parse_hex4(ptr + 1, &uc))
+				break;
+			ptr += 4;	/* get the unicode char. */
+
+			if ((uc >= 0xDC00 && uc <= 0xDFFF) || uc == 0)
+				break;	// check for invalid.
+
+			if (uc >= 0xD800 && uc <= 0xDBFF)	// UTF16 surrogate pairs.
+			{
+				if (end - ptr < 7 || ptr[1] != '\\' || ptr[2] != 'u'
+				    || parse_hex4(ptr + 3, &uc2))
+					break;	// missing second-half of surrogate.
+				ptr += 6;
+				if (uc2 < 0xDC00 || uc2 > 0xDFFF)
+					break;	// invalid second-half of surrogate.
+				uc = 0x10000 | ((uc & 0x3FF) << 10) |
+				    (uc2 & 0x3FF);
+			}
+
+			n = 4;
+			if (uc < 0x80)
+				n = 1;
+			else if (uc < 0x800)
+				n = 2;
+			else if (uc < 0x10000)
+				n = 3;
+			ptr2 += n;
+
+			switch (n) {
+			case 4:
+				*--ptr2 = ((uc | 0x80) & 0xBF);
+				uc >>= 6;
+			case 3:
+				*--ptr2 = ((uc | 0x80) & 0xBF);
+				uc >>= 6;
+			case 2:
+				*--ptr2 = ((uc | 0x80) & 0xBF);
+				uc >>= 6;
+			case 1:
+				*--ptr2 = (uc | firstByteMark[n]);
+			}
+			ptr2 += n;
+			break;
+		default:
+			*ptr2++ = *ptr;
+			break;
+		}
+		ptr++;
+	}
+	return ptr2 - out;
+}
+
+/* Unescape a string token into a newly allocated cstring. */
+static char *parse_string(const char *str, size_t len, int escaped)
+{
+	char *out;
+
+	out = (char *)json_item_alloc(len + 1);	/* unescaping never makes it longer */
+	if (!out)
+		return 0;
+
+	if (!escaped) {
+		memcpy(out, str, len);
+		out[len] = 0;
+		return out;
+	}
+	out[unescape_string(out, str, len)] = 0;
+	return out;
+}
+
+/* Render the cstring provided to an escaped version that can be printed. */
+static int print_string_ptr(const char *str, struct json_buffer *b)
+{
+	const char *ptr, *run;
+	unsigned char token;
+	char esc[8];
+
+	if (buffer_append(b, "\"", 1))
+		return -1;
+	for (ptr = str; ptr && *ptr;) {
+		/* copy the longest run that needs no escaping at once */
+		for (run = ptr; (unsigned char)*ptr > 31 && *ptr != '\"'
+		     && *ptr != '\\'; ptr++) ;
+		if (ptr > run && buffer_append(b, run, ptr - run))
+			return -1;
+		if (!*ptr)
+			break;
+		esc[0] = '\\';
+		switch (token = *ptr++) {
+		case '\\':
+			esc[1] = '\\';
+			break;
+		case '\"':
+			esc[1] = '\"';
+			break;
+		case '\b':
+			esc[1] = 'b';
+			break;
+		case '\f':
+			esc[1] = 'f';
+			break;
+		case '\n':
+			esc[1] = 'n';
+			break;
+		case '\r':
+			esc[1] = 'r';
+			break;
+		case '\t':
+			esc[1] = 't';
+			break;
+		default:
+			sprintf(esc + 1, "u%04x", token);
+			if (buffer_append(b, esc, 6))
+				return -1;
+			continue;
+		}
+		if (buffer_append(b, esc, 2))
+			return -1;
+	}
+	return buffer_append(b, "\"", 1);
+}
+
+/* Predeclare these prototypes. */
+static int print_value(struct json *item, int depth, int fmt,
+		       struct json_buffer *b);
+static int print_array(struct json *item, int depth, int fmt,
+		       struct json_buffer *b);
+static int print_object(struct json *item, int depth, int fmt,
+			struct json_buffer *b);
+static int print_lazy(struct json *item, struct json_buffer *b);
+static void suffix_object(struct json *prev, struct json *item);
+
+/*
+ * Scanners for the two runs the parser spends its time in: whitespace
+ * between tokens and the body of a string.  They look at 32 (AVX2) or 16
+ * (SSE2) bytes at a time, the variant is picked at load time (see
+ * scan_select()).
+ * Both return the offset of the first byte at or after i that stops the
+ * run, or len.
+ */
+static inline int is_space(char c)
+{
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+static size_t skip_space_scalar(const char *buf, size_t i, size_t len)
+{
+	while (i < len && is_space(buf[i]))
+		i++;
+	return i;
+}
+
+static size_t scan_string_scalar(const char *buf, size_t i, size_t len)
+{
+	while (i < len && buf[i] != '\"' && buf[i] != '\\')
+		i++;
+	return i;
+}
+
+#ifdef JSON_SCAN_X86
+static size_t skip_space_sse2(const char *buf, size_t i, size_t len)
+{
+	const __m128i sp = _mm_set1_epi8(' '), nl = _mm_set1_epi8('\n');
+	const __m128i tab = _mm_set1_epi8('\t'), cr = _mm_set1_epi8('\r');
+	__m128i v, ws;
+	unsigned m;
+
+	for (; i + 16 <= len; i += 16) {
+		v = _mm_loadu_si128((const __m128i *)(buf + i));
+		ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp),
+					       _mm_cmpeq_epi8(v, nl)),
+				  _mm_or_si128(_mm_cmpeq_epi8(v, tab),
+					       _mm_cmpeq_epi8(v, cr)));
+		m = ~_mm_movemask_epi8(ws) & 0xffff;
+		if (m)
+			return i + __builtin_ctz(m);
+	}
+	return skip_space_scalar(buf, i, len);
+}
+
+static size_t scan_string_sse2(const char *buf, size_t i, size_t len)
+{
+	const __m128i quote = _mm_set1_epi8('\"'), bslash = _mm_set1_epi8('\\');
+	__m128i v;
+	unsigned m;
+
+	for (; i + 16 <= len; i += 16) {
+		v = _mm_loadu_si128((const __m128i *)(buf + i));
+		m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+						   _mm_cmpeq_epi8(v, bslash)));
+		if (m)
+			return i + __builtin_ctz(m);
+	}
+	return scan_string_scalar(buf, i, len);
+}
+
+__attribute__ ((target("avx2")))
+static size_t skip_space_avx2(const char *buf, size_t i, size_t len)
+{
+	const __m256i sp = _mm256_set1_epi8(' '), nl = _mm256_set1_epi8('\n');
+	const __m256i tab = _mm256_set1_epi8('\t'), cr = _mm256_set1_epi8('\r');
+	__m256i v, ws;
+	unsigned m;
+
+	for (; i + 32 <= len; i += 32) {
+		v = _mm256_loadu_si256((const __m256i *)(buf + i));
+		ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp),
+						     _mm256_cmpeq_epi8(v, nl)),
+				     _mm256_or_si256(_mm256_cmpeq_epi8(v, tab),
+						     _mm256_cmpeq_epi8(v, cr)));
+		m = ~(unsigned)_mm256_movemask_epi8(ws);
+		if (m)
+			return i + __builtin_ctz(m);
+	}
+	return skip_space_sse2(buf, i, len);
+}
+
+__attribute__ ((target("avx2")))
+static size_t scan_string_avx2(const char *buf, size_t i, size_t len)
+{
+	const __m256i quote = _mm256_set1_epi8('\"');
+	const __m256i bslash = _mm256_set1_epi8('\\');
+	__m256i v;
+	unsigned m;
+
+	for (; i + 32 <= len; i += 32) {
+		v = _mm256_loadu_si256((const __m256i *)(buf + i));
+		m = _mm256_movemask_epi8(_mm256_or_si256
+					 (_mm256_cmpeq_epi8(v, quote),
+					  _mm256_cmpeq_epi8(v, bslash)));
+		if (m)
+			return i + __builtin_ctz(m);
+	}
+	return scan_string_sse2(buf, i, len);
+}
+#endif
+
+static size_t skip_space_init(const char *buf, size_t i, size_t len);
+static size_t scan_string_init(const char *buf, size_t i, size_t len);
+
+static size_t (*skip_space) (const char *buf, size_t i, size_t len) =
+    skip_space_init;
+static size_t (*scan_string) (const char *buf, size_t i, size_t len) =
+    scan_string_init;
+
+/*
+ * Picked once at load time, before any thread can parse; the init stubs
+ * only matter for parsing from other constructors.
+ */
+static void scan_select(void) __attribute__((constructor));
+
+static void scan_select(void)
+{
+#ifdef JSON_SCAN_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		skip_space = skip_space_avx2;
+		scan_string = scan_string_avx2;
+	} else {
+		skip_space = skip_space_sse2;
+		scan_string = scan_string_sse2;
+	}
+#else
+	skip_space = skip_space_scalar;
+	scan_string = scan_string_scalar;
+#endif
+}
+
+static size_t skip_space_init(const char *buf, size_t i, size_t len)
+{
+	scan_select();
+	return skip_space(buf, i, len);
+}
+
+static size_t scan_string_init(const char *buf, size_t i, size_t len)
+{
+	scan_select();
+	return scan_string(buf, i, len);
+}
+
+/* Incremental parser states. */
+enum {
+	PS_VALUE,		/* expecting a value */
+	PS_ARRAY_FIRST,		/* after '[', expecting a value or ']' */
+	PS_OBJECT_FIRST,	/* after '{', expecting a key or '}' */
+	PS_KEY,			/* after ',' in an object, expecting a key */
+	PS_COLON,		/* after a key, expecting ':' */
+	PS_NEXT,		/* after a member, expecting ',' or the closing bracket */
+	PS_STRING,		/* inside a string token */
+	PS_STRING_ESC,		/* inside a string token, right after a backslash */
+	PS_STRING_HEX,		/* ... inside the four hex digits of a \u escape */
+	PS_NUMBER,		/* inside a number token */
+	PS_LITERAL,		/* inside true/false/null */
+	PS_SKIM,		/* inside a lazy array/object */
+	PS_SKIM_STRING,		/* inside a string in a lazy array/object */
+	PS_SKIM_ESC,		/* ... right after a backslash */
+	PS_DONE,
+	PS_ERROR,
+};
+
+/* An array or object that has been opened but not closed yet. */
+struct json_parser_frame {
+	struct json *node;	/* NULL with events */
+	struct json *tail;	/* last child, new members are appended here */
+	int count;
+	int type;
+};
+
+void json_parser_init(struct json_parser *p)
+{
+	memset(p, 0, sizeof(*p));
+}
+
+void json_parser_reset(struct json_parser *p)
+{
+	json_delete(p->root);
+	if (p->key && !p->key_in_arena)
+		json_free(p->key);
+	p->root = 0;
+	p->key = 0;
+	p->depth = 0;
+	p->string_count = 0;
+	p->state = PS_VALUE;
+}
+
+void json_parser_destroy(struct json_parser *p)
+{
+	json_parser_reset(p);
+	if (p->stack)
+		json_free(p->stack);
+	p->stack = 0;
+	p->stack_size = 0;
+	if (p->strings)
+		json_free(p->strings);
+	p->strings = 0;
+	p->string_size = 0;
+	if (p->scratch)
+		json_free(p->scratch);
+	p->scratch = 0;
+	p->scratch_size = 0;
+}
+
+struct json *json_parser_result(struct json_parser *p)
+{
+	struct json *c = 0;
+
+	if (p->state == PS_DONE) {
+		c = p->root;
+		p->root = 0;
+		p->state = PS_VALUE;
+	}
+	return c;
+}
+
+/* Insitu strings are kept as offsets from the value's start while it is
+ * being built, since buf may move in between; the slots referring to them
+ * are noted and pointed into buf once the value is complete.  Every string
+ * makes room first for its own slot and its member name's, so noting can't
+ * fail. */
+static int parser_note_reserve(struct json_parser *p)
+{
+	char ***strings;
+	int size;
+
+	if (p->string_count + 2 <= p->string_size)
+		return 0;
+	size = p->string_size ? p->string_size * 2 : 64;
+	strings = (char ***)json_malloc(size * sizeof(char **));
+	if (!strings)
+		return -1;
+	if (p->strings) {
+		memcpy(strings, p->strings, p->string_count * sizeof(char **));
+		json_free(p->strings);
+	}
+	p->strings = strings;
+	p->string_size = size;
+	return 0;
+}
+
+static void parser_rebase(struct json_parser *p, size_t from, char *to)
+{
+	int i;
+
+	for (i = 0; i < p->string_count; i++)
+		*p->strings[i] = to + ((size_t)*p->strings[i] - from);
+}
+
+void json_parser_relocate(struct json_parser *p, const char *buf, char *to)
+{
+	memcpy(to, buf + p->start, p->pos - p->start);
+	parser_rebase(p, (size_t)(buf + p->start), to);
+}
+
+/* Hook a finished value (or a freshly opened container) into the tree. */
+static void parser_add(struct json_parser *p, struct json *item)
+{
+	struct json_parser_frame *f;
+
+	if (!p->depth) {
+		p->root = item;
+		return;
+	}
+	f = &p->stack[p->depth - 1];
+	if (f->node->type == JSON_T_OBJECT) {
+		item->string = p->key;
+		if (p->key_in_arena)
+			item->flags |= JSON_F_ARENA_NAME;
+		if (p->insitu)
+			p->strings[p->string_count++] = &item->string;
+		p->key = 0;
+	}
+	if (f->tail)
+		suffix_object(f->tail, item);
+	else
+		f->node->child = item;
+	f->tail = item;
+	f->count++;
+}
+
+/* A scalar value or a container has been completed. */
+static void parser_value_done(struct json_parser *p)
+{
+	p->state = p->depth ? PS_NEXT : PS_DONE;
+}
+
+/* Report an event to p->events, if it has a callback for it. */
+#define parser_event(p, name, ...) \
+	((p)->events->name ? (p)->events->name((p)->ctx, ##__VA_ARGS__) : 0)
+
+static int parser_open(struct json_parser *p, int type)
+{
+	struct json_parser_frame *stack;
+	struct json *item;
+	int size;
+
+	if (p->depth == p->stack_size) {
+		size = p->stack_size ? p->stack_size * 2 : 16;
+		stack = (struct json_parser_frame *)
+		    json_malloc(size * sizeof(struct json_parser_frame));
+		if (!stack)
+			return -1;
+		if (p->stack) {
+			memcpy(stack, p->stack,
+			       p->depth * sizeof(struct json_parser_frame));
+			json_free(p->stack);
+		}
+		p->stack = stack;
+		p->stack_size = size;
+	}
+	if (p->events) {
+		item = 0;
+		if (type == JSON_T_ARRAY ? parser_event(p, start_array) :
+		    parser_event(p, start_object))
+			return -1;
+	} else {
+		if (!(item = json_new_item()))
+			return -1;
+		item->type = type;
+		parser_add(p, item);
+	}
+	p->stack[p->depth].node = item;
+	p->stack[p->depth].tail = 0;
+	p->stack[p->depth].count = 0;
+	p->stack[p->depth].type = type;
+	p->depth++;
+	p->state = (type == JSON_T_ARRAY) ? PS_ARRAY_FIRST : PS_OBJECT_FIRST;
+	return 0;
+}
+
+static int parser_close(struct json_parser *p, char c)
+{
+	struct json_parser_frame *f = &p->stack[p->depth - 1];
+	int type = f->type;
+
+	if ((c == ']' && type != JSON_T_ARRAY) ||
+	    (c == '}' && type != JSON_T_OBJECT))
+		return -1;
+	if (p->events && (type == JSON_T_ARRAY ? parser_event(p, end_array) :
+			  parser_event(p, end_object)))
+		return -1;
+	/* heap values get their index when it is first needed, arena ones
+	 * can't once the arena is unbound so they get it now; the hash slots
+	 * are only filled in by the first lookup: insitu, the names can't
+	 * be read before the value is complete */
+	if (f->node && (f->node->flags & JSON_F_ARENA)) {
+		if (type == JSON_T_OBJECT && f->count >= JSON_HASH_MIN)
+			object_hash_init(f->node);
+		else if (f->count >= JSON_INDEX_MIN)
+			index_reserve(f->node, 0);
+	}
+	p->depth--;
+	parser_value_done(p);
+	return 0;
+}
+
+/* The string token buf[tok..end) (quotes included) is complete, with
+ * events: unescaped in place insitu, else in p->scratch if need be. */
+static int parser_string_event(struct json_parser *p, const char *buf,
+			       size_t end)
+{
+	const char *str = buf + p->tok + 1;
+	size_t len = end - p->tok - 2;
+	char *s;
+
+	if (p->insitu || !p->escaped) {
+		s = (char *)str;
+		if (p->escaped)
+			len = unescape_string(s, str, len);
+		if (p->insitu)
+			s[len] = 0;
+	} else {
+		if (p->scratch_size < len) {
+			if (!(s = (char *)json_malloc(len)))
+				return -1;
+			if (p->scratch)
+				json_free(p->scratch);
+			p->scratch = s;
+			p->scratch_size = len;
+		}
+		len = unescape_string(p->scratch, str, len);
+		str = p->scratch;
+	}
+	if (p->in_key) {
+		if (parser_event(p, key, str, len))
+			return -1;
+		p->state = PS_COLON;
+		return 0;
+	}
+	if (parser_event(p, string, str, len))
+		return -1;
+	parser_value_done(p);
+	return 0;
+}
+
+/* The string token buf[tok..end) (quotes included) is complete. */
+static int parser_string(struct json_parser *p, const char *buf, size_t end)
+{
+	struct json *item;
+	size_t len = end - p->tok - 2;
+	char *str;
+
+	if (p->events)
+		return parser_string_event(p, buf, end);
+	if (p->insitu) {
+		if (parser_note_reserve(p))
+			return -1;
+		str = (char *)buf + p->tok + 1;
+		if (p->escaped)
+			len = unescape_string(str, str, len);
+		str[len] = 0;
+		str = (char *)(str - buf - p->start);
+	} else if (!(str = parse_string(buf + p->tok + 1, len, p->escaped)))
+		return -1;
+	if (p->in_key) {
+		p->key = str;
+		p->key_in_arena = p->insitu || json_bound_arena != 0;
+		p->state = PS_COLON;
+		return 0;
+	}
+	if (!(item = json_new_item())) {
+		if (!json_bound_arena && !p->insitu)
+			json_free(str);
+		return -1;
+	}
+	item->type = JSON_T_STRING;
+	if (p->insitu) {
+		item->valuestring = str;
+		item->flags |= JSON_F_ARENA_VALUE;
+		p->strings[p->string_count++] = &item->valuestring;
+	} else
+		json_set_valuestring(item, str);
+	parser_add(p, item);
+	parser_value_done(p);
+	return 0;
+}
+
+/* Whether the value about to start is stored under the lazy name. */
+static int parser_lazy(struct json_parser *p, const char *buf)
+{
+	const char *key = p->key;
+
+	if (!p->lazy || !key)
+		return 0;
+	if (p->insitu)
+		key = buf + p->start + (size_t)key;
+	return !json_strcasecmp(key, p->lazy);
+}
+
+/* The lazy array/object buf[tok..end) has been skimmed, keep its text. */
+static int parser_skimmed(struct json_parser *p, const char *buf, size_t end)
+{
+	struct json_lazy *l;
+	struct json *item;
+	size_t len = end - p->tok;
+
+	if (p->insitu && parser_note_reserve(p))
+		return -1;
+	l = (struct json_lazy *)json_item_alloc(sizeof(*l) +
+						(p->insitu ? 0 : len));
+	if (!l)
+		return -1;
+	if (!(item = json_new_item())) {
+		if (!json_bound_arena)
+			json_free(l);
+		return -1;
+	}
+	item->type = buf[p->tok] == '[' ? JSON_T_ARRAY : JSON_T_OBJECT;
+	item->flags |= JSON_F_LAZY;
+	json_set_valuestring(item, (char *)l);
+	l->len = len;
+	l->arena = json_bound_arena;
+	if (p->insitu) {
+		l->text = (char *)(p->tok - p->start);
+		p->strings[p->string_count++] = &l->text;
+	} else {
+		l->text = (char *)(l + 1);
+		memcpy(l->text, buf + p->tok, len);
+	}
+	parser_add(p, item);
+	parser_value_done(p);
+	return 0;
+}
+
+/* The number token buf[tok..end) is complete. */
+static int parser_number(struct json_parser *p, const char *buf, size_t end)
+{
+	struct json *item, num;
+
+	if (p->events) {
+		if (parse_number(&num, buf + p->tok, end - p->tok) !=
+		    end - p->tok || parser_event(p, number, num.valueint64,
+						   num.valuedouble))
+			return -1;
+		parser_value_done(p);
+		return 0;
+	}
+	if (!(item = json_new_item()))
+		return -1;
+	if (parse_number(item, buf + p->tok, end - p->tok) != end - p->tok) {
+		json_delete(item);
+		return -1;
+	}
+	parser_add(p, item);
+	parser_value_done(p);
+	return 0;
+}
+
+static int parser_literal(struct json_parser *p)
+{
+	struct json *item;
+
+	if (p->events) {
+		if (p->literal[0] == 'n' ? parser_event(p, null) :
+		    parser_event(p, boolean, p->literal[0] == 't'))
+			return -1;
+		parser_value_done(p);
+		return 0;
+	}
+	if (!(item = json_new_item()))
+		return -1;
+	switch (p->literal[0]) {
+	case 'n':
+		item->type = JSON_T_NULL;
+		break;
+	case 'f':
+		item->type = JSON_T_FALSE;
+		break;
+	case 't':
+		item->type = JSON_T_TRUE;
+		item->valueint = 1;
+		break;
+	}
+	parser_add(p, item);
+	parser_value_done(p);
+	return 0;
+}
+
+static inline int is_number_char(char c)
+{
+	return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.'
+	    || c == 'e' || c == 'E';
+}
+
+/* Parser core - scan buf[pos..len) once, carrying any partial token and the
+ * nesting stack over to the next call. */
+static int parser_feed(struct json_parser *p, const char *buf, size_t len)
+{
+	size_t i = p->pos;
+	char c;
+
+	if (p->state == PS_DONE)
+		return JSON_PARSE_DONE;
+	if (p->state == PS_ERROR)
+		return JSON_PARSE_ERROR;
+
+	while (i < len && p->state != PS_DONE) {
+		switch (p->state) {
+		case PS_STRING:
+			i = scan_string(buf, i, len);
+			if (i == len)
+				continue;
+			if (buf[i++] == '\\') {
+				p->escaped = 1;
+				p->state = PS_STRING_ESC;
+			} else if (parser_string(p, buf, i))
+				goto fail;
+			continue;
+		case PS_STRING_ESC:
+			c = buf[i++];
+			if (c == 'u') {
+				p->hex = 4;
+				p->state = PS_STRING_HEX;
+				continue;
+			}
+			if (!c || !strchr("\"\\/bfnrt", c))
+				goto fail;
+			p->state = PS_STRING;
+			continue;
+		case PS_STRING_HEX:
+			for (; i < len && p->hex; i++, p->hex--)
+				if (!isxdigit((unsigned char)buf[i]))
+					goto fail;
+			if (!p->hex)
+				p->state = PS_STRING;
+			continue;
+		case PS_NUMBER:
+			while (i < len && is_number_char(buf[i]))
+				i++;
+			if (i < len && parser_number(p, buf, i))
+				goto fail;
+			continue;
+		case PS_LITERAL:
+			while (i < len && p->literal[i - p->tok]) {
+				if (buf[i] != p->literal[i - p->tok])
+					goto fail;
+				i++;
+			}
+			if (!p->literal[i - p->tok] && parser_literal(p))
+				goto fail;
+			continue;
+		case PS_SKIM:
+			/* only the nesting and the strings matter here, the
+			 * rest is checked when the value is expanded */
+			while (i < len) {
+				c = buf[i++];
+				if (c == '\"') {
+					p->state = PS_SKIM_STRING;
+					break;
+				}
+				if (c == '[' || c == '{')
+					p->skim++;
+				else if ((c == ']' || c == '}') && !--p->skim) {
+					if (parser_skimmed(p, buf, i))
+						goto fail;
+					break;
+				}
+			}
+			continue;
+		case PS_SKIM_STRING:
+			i = scan_string(buf, i, len);
+			if (i < len)
+				p->state = buf[i++] == '\\' ? PS_SKIM_ESC : PS_SKIM;
+			continue;
+		case PS_SKIM_ESC:
+			i++;
+			p->state = PS_SKIM_STRING;
+			continue;
+		}
+
+		c = buf[i];
+		if (is_space(c)) {
+			/* a lone separator is the common case */
+			if (++i < len && is_space(buf[i]))
+				i = skip_space(buf, i, len);
+			continue;
+		}
+
+		switch (p->state) {
+		case PS_OBJECT_FIRST:
+			if (c == '}')
+				goto close;
+			/* fall through */
+		case PS_KEY:
+			if (c != '\"')
+				goto fail;
+			p->in_key = 1;
+			goto string;
+		case PS_COLON:
+			if (c != ':')
+				goto fail;
+			p->state = PS_VALUE;
+			i++;
+			continue;
+		case PS_NEXT:
+			if (c == ']' || c == '}')
+				goto close;
+			if (c != ',')
+				goto fail;
+			/* no closing bracket right after a comma */
+			p->state = (p->stack[p->depth - 1].type ==
+				    JSON_T_ARRAY) ? PS_VALUE : PS_KEY;
+			i++;
+			continue;
+		case PS_ARRAY_FIRST:
+			if (c == ']')
+				goto close;
+			break;
+		}
+
+		/* PS_VALUE, PS_ARRAY_FIRST */
+		p->tok = i;
+		if (!p->depth) {
+			p->start = i;
+			p->string_count = 0;
+		}
+		switch (c) {
+		case '\"':
+			p->in_key = 0;
+			goto string;
+		case '-':
+		case '0' ... '9':
+			p->state = PS_NUMBER;
+			continue;
+		case 'n':
+			p->literal = "null";
+			p->state = PS_LITERAL;
+			continue;
+		case 'f':
+			p->literal = "false";
+			p->state = PS_LITERAL;
+			continue;
+		case 't':
+			p->literal = "true";
+			p->state = PS_LITERAL;
+			continue;
+		case '[':
+			if (parser_lazy(p, buf))
+				goto skim;
+			if (parser_open(p, JSON_T_ARRAY))
+				goto fail;
+			i++;
+			continue;
+		case '{':
+			if (parser_lazy(p, buf))
+				goto skim;
+			if (parser_open(p, JSON_T_OBJECT))
+				goto fail;
+			i++;
+			continue;
+		}
+		goto fail;
+
+string:
+		p->tok = i++;
+		p->escaped = 0;
+		p->state = PS_STRING;
+		continue;
+skim:
+		p->skim = 1;
+		p->state = PS_SKIM;
+		i++;
+		continue;
+close:
+		if (parser_close(p, c))
+			goto fail;
+		i++;
+	}
+
+	p->pos = i;
+	if (p->state != PS_DONE)
+		return JSON_PARSE_MORE;
+	if (p->insitu)
+		parser_rebase(p, 0, (char *)buf + p->start);
+	return JSON_PARSE_DONE;
+fail:
+	p->pos = i;
+	json_parser_reset(p);
+	p->state = PS_ERROR;
+	return JSON_PARSE_ERROR;
+}
+
+int json_parser_feed(struct json_parser *p, const char *buf, size_t len)
+{
+	struct json_arena *prev;
+	int ret;
+
+	if (!p->arena)
+		return parser_feed(p, buf, len);
+	prev = json_arena_bind(p->arena);
+	ret = parser_feed(p, buf, len);
+	json_arena_bind(prev);
+	return ret;
+}
+
+int json_parser_finish(struct json_parser *p, const char *buf, size_t len)
+{
+	struct json_arena *prev;
+	int ret = json_parser_feed(p, buf, len);
+
+	/* a top level number can only be terminated by the end of input */
+	if (ret == JSON_PARSE_MORE && p->state == PS_NUMBER && !p->depth) {
+		prev = json_arena_bind(p->arena ? p->arena : json_bound_arena);
+		ret = parser_number(p, buf, len);
+		json_arena_bind(prev);
+		if (ret) {
+			json_parser_reset(p);
+			p->state = PS_ERROR;
+			return JSON_PARSE_ERROR;
+		}
+		ret = JSON_PARSE_DONE;
+	}
+	return ret;
+}
+
+size_t json_parser_compact(struct json_parser *p, char *buf, size_t len)
+{
+	size_t keep, n;
+
+	switch (p->state) {
+	case PS_STRING:
+	case PS_STRING_ESC:
+	case PS_STRING_HEX:
+	case PS_NUMBER:
+	case PS_LITERAL:
+	case PS_SKIM:
+	case PS_SKIM_STRING:
+	case PS_SKIM_ESC:
+		keep = p->tok;
+		break;
+	default:
+		keep = p->pos;
+	}
+	if (p->insitu && p->depth)
+		keep = p->start;	/* the value refers to its bytes */
+
+	/* only move the pending bytes when that pays for itself, so a single
+	 * huge token isn't copied over and over again */
+	n = len - keep;
+	if (!keep || keep < n)
+		return len;
+	memmove(buf, buf + keep, n);
+	p->pos -= keep;
+	p->tok -= keep;
+	p->start = p->start > keep ? p->start - keep : 0;
+	return n;
+}
+
+/* Parse an object - create a new root, and populate. */
+struct json *json_parse(const char *value)
+{
+	char *end_ptr;
+
+	return json_parse_stream(value, &end_ptr);
+}
+
+/* Parse an object - create a new root, and populate
+ *  Also indicates where in the stream the Object ends. */
+struct json *json_parse_stream(const char *value, char **end_ptr)
+{
+	struct json_parser p;
+	struct json *c = 0;
+	size_t len;
+
+	if (!end_ptr)
+		return NULL;
+
+	len = strlen(value);
+	json_parser_init(&p);
+	if (json_parser_finish(&p, value, len) == JSON_PARSE_DONE)
+		c = json_parser_result(&p);
+	*end_ptr = (char *)value + p.pos;
+	json_parser_destroy(&p);
+	return c;
+}
+
+struct json *json_parse_insitu(char *value)
+{
+	struct json_parser p;
+	struct json *c = 0;
+
+	json_parser_init(&p);
+	p.insitu = 1;
+	if (json_parser_finish(&p, value, strlen(value)) == JSON_PARSE_DONE)
+		c = json_parser_result(&p);
+	json_parser_destroy(&p);
+	return c;
+}
+
+int json_expand(struct json *item)
+{
+	struct json_lazy *l;
+	struct json_parser p;
+	struct json_arena *prev;
+	struct json *c = 0;
+	int insitu;
+
+	if (!item || !(item->flags & JSON_F_LAZY))
+		return 0;
+	if (item->type & JSON_T_IS_REFERENCE)
+		return -1;
+	l = (struct json_lazy *)item->valuestring;
+	/* text in an arena or a buffer outlives the children, heap text
+	 * goes away with the item */
+	insitu = (item->flags & JSON_F_ARENA_VALUE) != 0;
+
+	prev = json_arena_bind(l->arena);
+	json_parser_init(&p);
+	p.insitu = insitu;
+	if (json_parser_finish(&p, l->text, l->len) == JSON_PARSE_DONE)
+		c = json_parser_result(&p);
+	json_parser_destroy(&p);
+	json_arena_bind(prev);
+
+	/* a failed expansion leaves the item empty, insitu may have
+	 * scribbled over its text */
+	item->flags &= ~JSON_F_LAZY;
+	item->valuestring = 0;
+	if (!insitu)
+		json_free(l);
+	if (!c)
+		return -1;
+	item->child = c->child;
+	c->child = 0;
+	/* the index is freed the way its owner is */
+	if ((item->flags ^ c->flags) & JSON_F_ARENA)
+		index_free(c);
+	item->index = c->index;
+	c->index = 0;
+	json_delete(c);
+	return 0;
+}
+
+const char *json_get_raw(struct json *item, size_t *len)
+{
+	struct json_lazy *l;
+
+	if (!(item->flags & JSON_F_LAZY))
+		return 0;
+	l = (struct json_lazy *)item->valuestring;
+	*len = l->len;
+	return l->text;
+}
+
+void json_set_lazy_arena(struct json *item, struct json_arena *arena)
+{
+	if (item->flags & JSON_F_LAZY)
+		((struct json_lazy *)item->valuestring)->arena = arena;
+}
+
+/* Tape words: the tag in the top byte, then
+ *  '[' '{'	the element count (bits 32..55, saturated) and the index of
+ *		the closing word (bits 0..31)
+ *  ']' '}'	the index of the opening word
+ *  '"' 'k'	the offset of a string value/member name in strings, where it
+ *		follows its 32-bit length and is NUL terminated
+ *  'l' 'd'	the next word holds the int64_t/double
+ *  't' 'f' 'n'
+ * Members are a 'k' word followed by the value. */
+#define TAPE_TAG(w) ((unsigned)((w) >> 56))
+#define TAPE_WORD(tag, v) ((uint64_t)(tag) << 56 | (v))
+#define TAPE_COUNT_MAX 0xffffff
+#define TAPE_INDEX_MAX 0xffffffffu
+
+void json_tape_init(struct json_tape *t)
+{
+	memset(t, 0, sizeof(*t));
+}
+
+void json_tape_reset(struct json_tape *t)
+{
+	t->len = 0;
+	t->strings.len = 0;
+	t->depth = 0;
+}
+
+void json_tape_destroy(struct json_tape *t)
+{
+	if (t->words)
+		json_free(t->words);
+	if (t->open)
+		json_free(t->open);
+	json_buffer_free(&t->strings);
+	json_tape_init(t);
+}
+
+static int tape_reserve(struct json_tape *t, size_t n)
+{
+	uint64_t *words;
+	size_t size;
+
+	if (t->size - t->len >= n)
+		return 0;
+	size = t->size ? t->size * 2 : 256;
+	while (size - t->len < n)
+		size *= 2;
+	if (size > TAPE_INDEX_MAX ||
+	    !(words = (uint64_t *)json_malloc(size * sizeof(uint64_t))))
+		return -1;
+	if (t->words) {
+		memcpy(words, t->words, t->len * sizeof(uint64_t));
+		json_free(t->words);
+	}
+	t->words = words;
+	t->size = size;
+	return 0;
+}
+
+/* A value starts: count it in the open array/object, make room for it. */
+static int tape_value(struct json_tape *t, size_t n)
+{
+	if (t->depth) {
+		size_t *open = &t->open[t->depth - 1];
+		uint64_t *w = &t->words[*open];
+
+		if (((*w >> 32) & TAPE_COUNT_MAX) < TAPE_COUNT_MAX)
+			*w += 1ULL << 32;
+	}
+	return tape_reserve(t, n);
+}
+
+static int tape_string(struct json_tape *t, char tag, const char *str,
+		       size_t len)
+{
+	struct json_buffer *b = &t->strings;
+	uint32_t l = len;
+
+	if (b->len + sizeof(l) + len > TAPE_INDEX_MAX ||
+	    buffer_reserve(b, sizeof(l) + len))
+		return -1;
+	memcpy(b->data + b->len, &l, sizeof(l));
+	b->len += sizeof(l);
+	t->words[t->len++] = TAPE_WORD(tag, b->len);
+	memcpy(b->data + b->len, str, len);
+	b->len += len;
+	b->data[b->len++] = 0;
+	return 0;
+}
+
+static int tape_open(void *ctx, char tag)
+{
+	struct json_tape *t = (struct json_tape *)ctx;
+	size_t *open;
+	int size;
+
+	if (tape_value(t, 1))
+		return -1;
+	if (t->depth == t->open_size) {
+		size = t->open_size ? t->open_size * 2 : 16;
+		if (!(open = (size_t *)json_malloc(size * sizeof(size_t))))
+			return -1;
+		if (t->open) {
+			memcpy(open, t->open, t->depth * sizeof(size_t));
+			json_free(t->open);
+		}
+		t->open = open;
+		t->open_size = size;
+	}
+	t->open[t->depth++] = t->len;
+	t->words[t->len++] = TAPE_WORD(tag, 0);
+	return 0;
+}
+
+static int tape_close(void *ctx, char tag)
+{
+	struct json_tape *t = (struct json_tape *)ctx;
+	size_t open = t->open[--t->depth];
+
+	if (tape_reserve(t, 1))
+		return -1;
+	t->words[open] |= t->len;
+	t->words[t->len++] = TAPE_WORD(tag, open);
+	return 0;
+}
+
+static int tape_start_object(void *ctx)
+{
+	return tape_open(ctx, '{');
+}
+
+static int tape_end_object(void *ctx)
+{
+	return tape_close(ctx, '}');
+}
+
+static int tape_start_array(void *ctx)
+{
+	return tape_open(ctx, '[');
+}
+
+static int tape_end_array(void *ctx)
+{
+	return tape_close(ctx, ']');
+}
+
+static int tape_key(void *ctx, const char *str, size_t len)
+{
+	struct json_tape *t = (struct json_tape *)ctx;
+
+	return tape_reserve(t, 1) || tape_string(t, 'k', str, len);
+}
+
+static int tape_string_value(void *ctx, const char *str, size_t len)
+{
+	struct json_tape *t = (struct json_tape *)ctx;
+
+	return tape_value(t, 1) || tape_string(t, '"', str, len);
+}
+
+/* Integers are kept as such, other numbers as doubles. */
+static int tape_number(void *ctx, int64_t i, double d)
+{
+	struct json_tape *t = (struct json_tape *)ctx;
+
+	if (tape_value(t, 2))
+		return -1;
+	if (d == (double)i) {
+		t->words[t->len++] = TAPE_WORD('l', 0);
+		memcpy(&t->words[t->len++], &i, sizeof(i));
+	} else {
+		t->words[t->len++] = TAPE_WORD('d', 0);
+		memcpy(&t->words[t->len++], &d, sizeof(d));
+	}
+	return 0;
+}
+
+static int tape_boolean(void *ctx, int b)
+{
+	struct json_tape *t = (struct json_tape *)ctx;
+
+	if (tape_value(t, 1))
+		return -1;
+	t->words[t->len++] = TAPE_WORD(b ? 't' : 'f', 0);
+	return 0;
+}
+
+static int tape_null(void *ctx)
+{
+	struct json_tape *t = (struct json_tape *)ctx;
+
+	if (tape_value(t, 1))
+		return -1;
+	t->words[t->len++] = TAPE_WORD('n', 0);
+	return 0;
+}
+
+const struct json_events json_tape_events = {
+	tape_start_object, tape_end_object, tape_start_array, tape_end_array,
+	tape_key, tape_string_value, tape_number, tape_boolean, tape_null,
+};
+
+/* Parse buf[0..len) into t, returns where the value ended or 0. */
+static size_t tape_parse(struct json_tape *t, const char *buf, size_t len)
+{
+	struct json_parser p;
+	size_t end = 0;
+
+	json_tape_reset(t);
+	json_parser_init(&p);
+	p.events = &json_tape_events;
+	p.ctx = t;
+	if (json_parser_finish(&p, buf, len) == JSON_PARSE_DONE)
+		end = p.pos;
+	json_parser_destroy(&p);
+	return end;
+}
+
+int json_tape_parse(struct json_tape *t, const char *buf, size_t len)
+{
+	return tape_parse(t, buf, len) ? 0 : -1;
+}
+
+int json_tape_parse_stream(struct json_tape *t, const char *value,
+			   char **end_ptr)
+{
+	size_t end = tape_parse(t, value, strlen(value));
+
+	if (end_ptr)
+		*end_ptr = (char *)value + end;
+	return end ? 0 : -1;
+}
+
+void json_tape_root(const struct json_tape *t, struct json_cursor *c)
+{
+	c->tape = t;
+	c->pos = 0;
+}
+
+static inline uint64_t cursor_word(const struct json_cursor *c)
+{
+	return c->tape->words[c->pos];
+}
+
+int json_cursor_type(const struct json_cursor *c)
+{
+	switch (TAPE_TAG(cursor_word(c))) {
+	case '[':
+		return JSON_T_ARRAY;
+	case '{':
+		return JSON_T_OBJECT;
+	case '"':
+		return JSON_T_STRING;
+	case 'l':
+	case 'd':
+		return JSON_T_NUMBER;
+	case 't':
+		return JSON_T_TRUE;
+	case 'f':
+		return JSON_T_FALSE;
+	}
+	return JSON_T_NULL;
+}
 
-				len = 4;
-				if (uc < 0x80)
-					len = 1;
-				else if (uc < 0x800)
-					len = 2;
-				else if (uc < 0x10000)
-					len = 3;
-				ptr2 += len;
-
-				switch (len) {
-				case 4:
-					*--ptr2 = ((uc | 0x80) & 0xBF);
-					uc >>= 6;
-				case 3:
-					*--ptr2 = ((uc | 0x80) & 0xBF);
-					uc >>= 6;
-				case 2:
-					*--ptr2 = ((uc | 0x80) & 0xBF);
-					uc >>= 6;
-				case 1:
-					*--ptr2 = (uc | firstByteMark[len]);
-				}
-				ptr2 += len;
-				break;
-			default:
-				*ptr2++ = *ptr;
-				break;
-			}
-			ptr++;
-		}
+double json_cursor_double(const struct json_cursor *c)
+{
+	const uint64_t *w = &c->tape->words[c->pos];
+	int64_t i;
+	double d;
+
+	switch (TAPE_TAG(*w)) {
+	case 'l':
+		memcpy(&i, w + 1, sizeof(i));
+		return (double)i;
+	case 'd':
+		memcpy(&d, w + 1, sizeof(d));
+		return d;
+	case 't':
+		return 1;
 	}
-	*ptr2 = 0;
-	if (*ptr == '\"')
-		ptr++;
-	item->valuestring = out;
-	item->type = JSON_T_STRING;
-	*str = ptr;
-	return str;
+	return 0;
 }
 
-/* Render the cstring provided to an escaped version that can be printed. */
-static char *print_string_ptr(const char *str)
+int64_t json_cursor_int64(const struct json_cursor *c)
 {
-	const char *ptr;
-	char *ptr2, *out;
-	int len = 0;
-	unsigned char token;
+	const uint64_t *w = &c->tape->words[c->pos];
+	int64_t i;
 
-	if (!str)
-		return json_strdup("");
-	ptr = str;
-	while ((token = *ptr) && ++len) {
-		if (strchr("\"\\\b\f\n\r\t", token))
-			len++;
-		else if (token < 32)
-			len += 5;
-		ptr++;
+	if (TAPE_TAG(*w) == 'l') {
+		memcpy(&i, w + 1, sizeof(i));
+		return i;
 	}
+	return double_to_int64(json_cursor_double(c));
+}
 
-	out = (char *)json_malloc(len + 3);
-	if (!out)
-		return 0;
+static const char *tape_string_at(const struct json_tape *t, uint64_t w,
+				  size_t *len)
+{
+	const char *s = t->strings.data + (w & TAPE_INDEX_MAX);
+	uint32_t l;
 
-	ptr2 = out;
-	ptr = str;
-	*ptr2++ = '\"';
-	while (*ptr) {
-		if ((unsigned char)*ptr > 31 && *ptr != '\"' && *ptr != '\\')
-			*ptr2++ = *ptr++;
-		else {
-			*ptr2++ = '\\';
-			switch (token = *ptr++) {
-			case '\\':
-				*ptr2++ = '\\';
-				break;
-			case '\"':
-				*ptr2++ = '\"';
-				break;
-			case '\b':
-				*ptr2++ = 'b';
-				break;
-			case '\f':
-				*ptr2++ = 'f';
-				break;
-			case '\n':
-				*ptr2++ = 'n';
-				break;
-			case '\r':
-				*ptr2++ = 'r';
-				break;
-			case '\t':
-				*ptr2++ = 't';
-				break;
-			default:
-				sprintf(ptr2, "u%04x", token);
-				ptr2 += 5;
-				break;	/* escape and print */
-			}
-		}
+	if (len) {
+		memcpy(&l, s - sizeof(l), sizeof(l));
+		*len = l;
 	}
-	*ptr2++ = '\"';
-	*ptr2++ = 0;
-	return out;
+	return s;
 }
 
-/* Invote print_string_ptr (which is useful) on an item. */
-static char *print_string(struct json *item)
+const char *json_cursor_string(const struct json_cursor *c, size_t *len)
 {
-	return print_string_ptr(item->valuestring);
+	uint64_t w = cursor_word(c);
+
+	if (TAPE_TAG(w) != '"')
+		return 0;
+	return tape_string_at(c->tape, w, len);
 }
 
-/* Predeclare these prototypes. */
-static char **parse_value(struct json *item, char **value);
-static char *print_value(struct json *item, int depth, int fmt);
-static char **parse_array(struct json *item, char **value);
-static char *print_array(struct json *item, int depth, int fmt);
-static char **parse_object(struct json *item, char **value);
-static char *print_object(struct json *item, int depth, int fmt);
+const char *json_cursor_name(const struct json_cursor *c)
+{
+	uint64_t w;
+
+	if (!c->pos || TAPE_TAG(w = c->tape->words[c->pos - 1]) != 'k')
+		return 0;
+	return tape_string_at(c->tape, w, 0);
+}
 
-/* Utility to jump whitespace and cr/lf */
-static inline char **skip(char **in)
+int json_cursor_size(const struct json_cursor *c)
 {
-	if (in && *in)
-		while (isspace(**in))
-			(*in)++;
-	return in;
+	uint64_t w = cursor_word(c);
+	struct json_cursor e;
+	int n;
+
+	if (TAPE_TAG(w) != '[' && TAPE_TAG(w) != '{')
+		return 0;
+	if ((n = (w >> 32) & TAPE_COUNT_MAX) < TAPE_COUNT_MAX)
+		return n;
+	/* saturated, count them */
+	json_cursor_child(c, &e);
+	for (n = 1; !json_cursor_next(&e); n++)
+		;
+	return n;
 }
 
-/* Parse an object - create a new root, and populate. */
-struct json *json_parse(const char *value)
+int json_cursor_child(const struct json_cursor *c, struct json_cursor *child)
 {
-	struct json *c = json_new_item();
-	if (!c)
-		return 0;	/* memory fail */
+	uint64_t w = cursor_word(c);
+	size_t pos = c->pos + 1;
+
+	if ((TAPE_TAG(w) != '[' && TAPE_TAG(w) != '{') ||
+	    (w & TAPE_INDEX_MAX) == pos)
+		return -1;
+	child->tape = c->tape;
+	child->pos = TAPE_TAG(w) == '{' ? pos + 1 : pos;
+	return 0;
+}
 
-	char **end_ptr = (char **)&value;
+int json_cursor_next(struct json_cursor *c)
+{
+	const uint64_t *words = c->tape->words;
+	uint64_t w = words[c->pos];
+	size_t pos;
 
-	if (!parse_value(c, skip(end_ptr))) {
-		json_delete(c);
-		return 0;
+	switch (TAPE_TAG(w)) {
+	case '[':
+	case '{':
+		pos = (w & TAPE_INDEX_MAX) + 1;
+		break;
+	case 'l':
+	case 'd':
+		pos = c->pos + 2;
+		break;
+	default:
+		pos = c->pos + 1;
 	}
-	return c;
+	if (pos >= c->tape->len)
+		return -1;
+	switch (TAPE_TAG(words[pos])) {
+	case ']':
+	case '}':
+		return -1;
+	case 'k':
+		pos++;
+	}
+	c->pos = pos;
+	return 0;
 }
 
-/* Parse an object - create a new root, and populate
- *  Also indicates where in the stream the Object ends. */
-struct json *json_parse_stream(const char *value, char **end_ptr)
+int json_cursor_get_array_item(const struct json_cursor *c, int item,
+			       struct json_cursor *out)
 {
-	if (!end_ptr)
-		return NULL;
-	struct json *c = json_new_item();
-	if (!c)
-		return 0;	/* memory fail */
+	if (item < 0 || json_cursor_child(c, out))
+		return -1;
+	while (item-- > 0)
+		if (json_cursor_next(out))
+			return -1;
+	return 0;
+}
+
+int json_cursor_get_object_item(const struct json_cursor *c,
+				const char *string, struct json_cursor *out)
+{
+	if (TAPE_TAG(cursor_word(c)) != '{' || json_cursor_child(c, out))
+		return -1;
+	do {
+		if (!json_strcasecmp(json_cursor_name(out), string))
+			return 0;
+	} while (!json_cursor_next(out));
+	return -1;
+}
 
-	*end_ptr = (char *)value;
+/* Render a struct json item/entity/structure to text. */
+int json_print_append(struct json_buffer *b, struct json *item, int fmt)
+{
+	size_t len = b->len;
 
-	if (!parse_value(c, skip(end_ptr))) {
-		json_delete(c);
-		return 0;
+	if (print_value(item, 0, fmt, b) || buffer_reserve(b, 0)) {
+		b->len = len;	/* drop the partial output */
+		if (b->data && b->size > len)
+			b->data[len] = 0;
+		return -1;
 	}
-	return c;
+	b->data[b->len] = 0;
+	return 0;
 }
 
-/* Render a struct json item/entity/structure to text. */
-char *json_sprint(struct json *item)
+int json_print_to_buffer(struct json *item, char *buf, size_t size, int fmt)
 {
-	return print_value(item, 0, 1);
+	struct json_buffer b;
+
+	b.data = buf;
+	b.len = 0;
+	b.size = size;
+	b.fixed = 1;
+	if (json_print_append(&b, item, fmt))
+		return -1;
+	return b.len;
 }
 
-char *json_sprint_unformatted(struct json *item)
+int json_buffer_append(struct json_buffer *b, const char *data, size_t len)
 {
-	return print_value(item, 0, 0);
+	if (buffer_append(b, data, len))
+		return -1;
+	b->data[b->len] = 0;	/* buffer_reserve left room for it */
+	return 0;
 }
 
-static int stream_cmp(char **stream, const char *str)
+void json_buffer_free(struct json_buffer *b)
 {
-	while (**stream == *str) {
-		(*stream)++;
-		str++;
-	}
-	if (*str == '\0')
-		return 0;
-	return **stream - *str;
+	if (b->data && !b->fixed)
+		json_free(b->data);
+	b->data = 0;
+	b->len = b->size = 0;
 }
 
-/* Parser core - when encountering text, process appropriately. */
-static char **parse_value(struct json *item, char **value)
+char *json_sprint(struct json *item)
 {
-	if (!stream_cmp(value, "null")) {
-		item->type = JSON_T_NULL;
-		return value;
-	} else if (!stream_cmp(value, "false")) {
-		item->type = JSON_T_FALSE;
-		return value;
-	} else if (!stream_cmp(value, "true")) {
-		item->type = JSON_T_TRUE;
-		item->valueint = 1;
-		return value;
-	}
+	struct json_buffer b;
 
-	switch (**value) {
-	case '"':
-		return parse_string(item, value);
-	case '-':
-	case '0' ... '9':
-		return parse_number(item, value);
-	case '[':
-		return parse_array(item, value);
-	case '{':
-		return parse_object(item, value);
+	memset(&b, 0, sizeof(b));
+	if (json_print_append(&b, item, 1)) {
+		json_buffer_free(&b);
+		return 0;
 	}
+	return b.data;
+}
 
-	return NULL;		/* failure */
+char *json_sprint_unformatted(struct json *item)
+{
+	struct json_buffer b;
+
+	memset(&b, 0, sizeof(b));
+	if (json_print_append(&b, item, 0)) {
+		json_buffer_free(&b);
+		return 0;
+	}
+	return b.data;
 }
 
 /* Render a value to text. */
-static char *print_value(struct json *item, int depth, int fmt)
+static int print_value(struct json *item, int depth, int fmt,
+		       struct json_buffer *b)
 {
-	char *out = 0;
 	if (!item)
-		return 0;
+		return -1;
 	switch ((item->type) & 255) {
 	case JSON_T_NULL:
-		out = json_strdup("null");
-		break;
+		return buffer_append(b, "null", 4);
 	case JSON_T_FALSE:
-		out = json_strdup("false");
-		break;
+		return buffer_append(b, "false", 5);
 	case JSON_T_TRUE:
-		out = json_strdup("true");
-		break;
+		return buffer_append(b, "true", 4);
 	case JSON_T_NUMBER:
-		out = print_number(item);
-		break;
+		return print_number(item, b);
 	case JSON_T_STRING:
-		out = print_string(item);
-		break;
+		return print_string_ptr(item->valuestring, b);
 	case JSON_T_ARRAY:
-		out = print_array(item, depth, fmt);
-		break;
+		if (item->flags & JSON_F_LAZY)
+			return print_lazy(item, b);
+		return print_array(item, depth, fmt, b);
 	case JSON_T_OBJECT:
-		out = print_object(item, depth, fmt);
-		break;
+		if (item->flags & JSON_F_LAZY)
+			return print_lazy(item, b);
+		return print_object(item, depth, fmt, b);
+	case JSON_T_RAW:
+		return buffer_append(b, ((struct json_raw *)item->valuestring)->text,
+				     ((struct json_raw *)item->valuestring)->len);
 	}
-	return out;
+	return -1;
 }
 
-/* Build an array from input text. */
-static char **parse_array(struct json *item, char **value)
+/* An array/object that was never expanded is copied out as it came in. */
+static int print_lazy(struct json *item, struct json_buffer *b)
 {
-	struct json *child;
-	if (**value != '[')	/* not an array! */
-		return NULL;
-
-	item->type = JSON_T_ARRAY;
-	(*value)++;
-	skip(value);
-	if (**value == ']') {
-		(*value)++;
-		return value;	/* empty array. */
-	}
-
-	item->child = child = json_new_item();
-	if (!item->child)
-		return 0;	/* memory fail */
-	if (!skip(parse_value(child, value)))	/* skip any spacing, get the value. */
-		return NULL;
-
-	while (**value == ',') {
-		(*value)++;
-		skip(value);
-		if (**value == ']') {
-			(*value)++;
-			break;
-		}
-
-		struct json *new_item;
-		if (!(new_item = json_new_item()))
-			return 0;	/* memory fail */
-		child->next = new_item;
-		new_item->prev = child;
-		child = new_item;
-		if (!skip(parse_value(child, value)))
-			return 0;	/* memory fail */
-	}
-
-	if (**value != ']')
-		return NULL;
-	(*value)++;
+	struct json_lazy *l = (struct json_lazy *)item->valuestring;
 
-	return value;
+	return buffer_append(b, l->text, l->len);
 }
 
 /* Render an array to text */
-static char *print_array(struct json *item, int depth, int fmt)
-{
-	char **entries;
-	char *out = 0, *ptr, *ret;
-	int len = 5;
-	struct json *child = item->child;
-	int numentries = 0, i = 0, fail = 0;
-
-	/* How many entries in the array? */
-	while (child)
-		numentries++, child = child->next;
-	/* Allocate an array to hold the values for each */
-	entries = (char **)json_malloc(numentries * sizeof(char *));
-	if (!entries)
-		return 0;
-	memset(entries, 0, numentries * sizeof(char *));
-	/* Retrieve all the results: */
-	child = item->child;
-	while (child && !fail) {
-		ret = print_value(child, depth + 1, fmt);
-		entries[i++] = ret;
-		if (ret)
-			len += strlen(ret) + 2 + (fmt ? 1 : 0);
-		else
-			fail = 1;
-		child = child->next;
-	}
-
-	/* If we didn't fail, try to malloc the output string */
-	if (!fail)
-		out = (char *)json_malloc(len);
-	/* If that fails, we fail. */
-	if (!out)
-		fail = 1;
-
-	/* Handle failure. */
-	if (fail) {
-		for (i = 0; i < numentries; i++)
-			if (entries[i])
-				json_free(entries[i]);
-		json_free(entries);
-		return 0;
-	}
-
-	/* Compose the output array. */
-	*out = '[';
-	ptr = out + 1;
-	*ptr = 0;
-	for (i = 0; i < numentries; i++) {
-		strcpy(ptr, entries[i]);
-		ptr += strlen(entries[i]);
-		if (i != numentries - 1) {
-			*ptr++ = ',';
-			if (fmt)
-				*ptr++ = ' ';
-			*ptr = 0;
-		}
-		json_free(entries[i]);
-	}
-	json_free(entries);
-	*ptr++ = ']';
-	*ptr++ = 0;
-	return out;
-}
-
-/* Build an object from the text. */
-static char **parse_object(struct json *item, char **value)
+static int print_array(struct json *item, int depth, int fmt,
+		       struct json_buffer *b)
 {
 	struct json *child;
-	if (**value != '{')
-		return NULL;	/* not an object! */
 
-	item->type = JSON_T_OBJECT;
-	(*value)++;
-	skip(value);
-	if (**value == '}') {
-		(*value)++;
-		return value;	/* empty object. */
+	if (buffer_append(b, "[", 1))
+		return -1;
+	for (child = item->child; child; child = child->next) {
+		if (print_value(child, depth + 1, fmt, b))
+			return -1;
+		if (child->next && buffer_append(b, ", ", fmt ? 2 : 1))
+			return -1;
 	}
-
-	item->child = child = json_new_item();
-	if (!item->child)
-		return 0;
-	if (!skip(parse_string(child, value)))
-		return 0;
-	child->string = child->valuestring;
-	child->valuestring = 0;
-	if (**value != ':')
-		return NULL;	/* fail! */
-	(*value)++;
-	if (!skip(parse_value(child, skip(value))))	/* skip any spacing, get the value. */
-		return 0;
-
-	while (**value == ',') {
-		(*value)++;
-		skip(value);
-
-		if (**value == '}') {
-			(*value)++;
-			break;
-		}
-
-		struct json *new_item;
-		if (!(new_item = json_new_item()))
-			return 0;	/* memory fail */
-		child->next = new_item;
-		new_item->prev = child;
-		child = new_item;
-		if (!skip(parse_string(child, value)))
-			return 0;
-		child->string = child->valuestring;
-		child->valuestring = 0;
-		if (**value != ':')
-			return NULL;	/* fail! */
-		(*value)++;
-		if (!skip(parse_value(child, skip(value))))	/* skip any spacing, get the value. */
-			return 0;
-	}
-
-	if (**value != '}')
-		return NULL;
-	(*value)++;
-
-	return value;
+	return buffer_append(b, "]", 1);
 }
 
 /* Render an object to text. */
-static char *print_object(struct json *item, int depth, int fmt)
-{
-	char **entries = 0, **names = 0;
-	char *out = 0, *ptr, *ret, *str;
-	int len = 7, i = 0, j;
-	struct json *child = item->child;
-	int numentries = 0, fail = 0;
-	/* Count the number of entries. */
-	while (child)
-		numentries++, child = child->next;
-	/* Allocate space for the names and the objects */
-	entries = (char **)json_malloc(numentries * sizeof(char *));
-	if (!entries)
-		return 0;
-	names = (char **)json_malloc(numentries * sizeof(char *));
-	if (!names) {
-		json_free(entries);
-		return 0;
-	}
-	memset(entries, 0, sizeof(char *) * numentries);
-	memset(names, 0, sizeof(char *) * numentries);
+static int print_object(struct json *item, int depth, int fmt,
+			struct json_buffer *b)
+{
+	struct json *child;
 
-	/* Collect all the results into our arrays: */
-	child = item->child;
 	depth++;
-	if (fmt)
-		len += depth;
-	while (child) {
-		names[i] = str = print_string_ptr(child->string);
-		entries[i++] = ret = print_value(child, depth, fmt);
-		if (str && ret)
-			len +=
-			    strlen(ret) + strlen(str) + 2 + (fmt ? 2 +
-							     depth : 0);
-		else
-			fail = 1;
-		child = child->next;
-	}
-
-	/* Try to allocate the output string */
-	if (!fail)
-		out = (char *)json_malloc(len);
-	if (!out)
-		fail = 1;
-
-	/* Handle failure */
-	if (fail) {
-		for (i = 0; i < numentries; i++) {
-			if (names[i])
-				json_free(names[i]);
-			if (entries[i])
-				json_free(entries[i]);
-		}
-		json_free(names);
-		json_free(entries);
-		return 0;
+	if (buffer_append(b, "{\n", fmt ? 2 : 1))
+		return -1;
+	for (child = item->child; child; child = child->next) {
+		if (fmt && buffer_fill(b, '\t', depth))
+			return -1;
+		if (print_string_ptr(child->string, b)
+		    || buffer_append(b, ":\t", fmt ? 2 : 1)
+		    || print_value(child, depth, fmt, b))
+			return -1;
+		if (child->next && buffer_append(b, ",", 1))
+			return -1;
+		if (fmt && buffer_append(b, "\n", 1))
+			return -1;
 	}
-
-	/* Compose the output: */
-	*out = '{';
-	ptr = out + 1;
-	if (fmt)
-		*ptr++ = '\n';
-	*ptr = 0;
-	for (i = 0; i < numentries; i++) {
-		if (fmt)
-			for (j = 0; j < depth; j++)
-				*ptr++ = '\t';
-		strcpy(ptr, names[i]);
-		ptr += strlen(names[i]);
-		*ptr++ = ':';
-		if (fmt)
-			*ptr++ = '\t';
-		strcpy(ptr, entries[i]);
-		ptr += strlen(entries[i]);
-		if (i != numentries - 1)
-			*ptr++ = ',';
-		if (fmt)
-			*ptr++ = '\n';
-		*ptr = 0;
-		json_free(names[i]);
-		json_free(entries[i]);
-	}
-
-	json_free(names);
-	json_free(entries);
-	if (fmt)
-		for (i = 0; i < depth - 1; i++)
-			*ptr++ = '\t';
-	*ptr++ = '}';
-	*ptr++ = 0;
-	return out;
+	if (fmt && buffer_fill(b, '\t', depth - 1))
+		return -1;
+	return buffer_append(b, "}", 1);
 }
 
 /* Get Array size/item / object item. */
 int json_get_array_size(struct json *array)
 {
-	struct json *c = array->child;
+	struct json *c;
 	int i = 0;
+	json_touch(array);
+	if (index_valid(array))
+		return array->index->count;
+	c = array->child;
 	while (c)
 		i++, c = c->next;
+	if (i >= JSON_INDEX_MIN)
+		index_reserve(array, 0);
 	return i;
 }
 
 struct json *json_get_array_item(struct json *array, int item)
 {
-	struct json *c = array->child;
-	while (c && item > 0)
-		item--, c = c->next;
+	struct json *c;
+	int i = item;
+	json_touch(array);
+	if (index_valid(array))
+		return item >= array->index->count ? 0 :
+		    item > 0 ? array->index->items[item] : array->child;
+	c = array->child;
+	while (c && i > 0)
+		i--, c = c->next;
+	if (item >= JSON_INDEX_MIN)
+		index_reserve(array, 0);
 	return c;
 }
 
 struct json *json_get_object_item(struct json *object, const char *string)
 {
-	struct json *c = object->child;
-	while (c && json_strcasecmp(c->string, string))
-		c = c->next;
-	return c;
+	return object_find(object, string, 0);
+}
+
+struct json *json_get_object_item_case_sensitive(struct json *object,
+						 const char *string)
+{
+	return object_find(object, string, 1);
+}
+
+int json_array_reserve(struct json *array, int count)
+{
+	json_touch(array);
+	return index_reserve(array, count);
 }
 
 /* Utility for array list handling. */
@@ -792,6 +3471,9 @@ static struct json *create_reference(struct json *item)
 		return 0;
 	memcpy(ref, item, sizeof(*ref));
 	ref->string = 0;
+	ref->index = 0;
+	ref->flags = (json_bound_arena ? JSON_F_ARENA : 0)
+	    | (item->flags & JSON_F_LAZY);
 	ref->type |= JSON_T_IS_REFERENCE;
 	ref->next = ref->prev = 0;
 	return ref;
@@ -800,9 +3482,25 @@ static struct json *create_reference(struct json *item)
 /* Add item to array/object. */
 void json_add_item_to_array(struct json *array, struct json *item)
 {
-	struct json *c = array->child;
+	struct json *c;
+	struct json_index *idx;
 	if (!item)
 		return;
+	json_touch(array);
+	c = array->child;
+	if (!index_reserve(array, 1)) {
+		idx = array->index;
+		if (idx->count)
+			suffix_object(idx->items[idx->count - 1], item);
+		else
+			array->child = item;
+		idx->items[idx->count++] = item;
+		if (idx->hashed && 2 * idx->count <= idx->hash_size)
+			hash_insert(idx, item);
+		else if (idx->hashed && hash_fill(array))
+			hash_free(array);
+		return;
+	}
 	if (!c) {
 		array->child = item;
 	} else {
@@ -817,9 +3515,7 @@ void json_add_item_to_object(struct json *object, const char *string,
 {
 	if (!item)
 		return;
-	if (item->string)
-		json_free(item->string);
-	item->string = json_strdup(string);
+	json_set_name(item, json_item_strdup(string));
 	json_add_item_to_array(object, item);
 }
 
@@ -834,13 +3530,30 @@ void json_add_item_reference_to_object(struct json *object, const char *string,
 	json_add_item_to_object(object, string, create_reference(item));
 }
 
-struct json *json_detach_item_from_array(struct json *array, int which)
+/* Position of child c in the index. */
+static int index_find(struct json_index *idx, struct json *c)
 {
-	struct json *c = array->child;
-	while (c && which > 0)
-		c = c->next, which--;
-	if (!c)
-		return 0;
+	int i = 0;
+
+	while (idx->items[i] != c)
+		i++;
+	return i;
+}
+
+/* Unlink child c, which is at position i (or -1 if that isn't known). */
+static struct json *detach_child(struct json *array, struct json *c, int i)
+{
+	struct json_index *idx = array->index;
+
+	if (index_valid(array)) {
+		if (i < 0)
+			i = index_find(idx, c);
+		idx->count--;
+		memmove(idx->items + i, idx->items + i + 1,
+			(idx->count - i) * sizeof(struct json *));
+		if (idx->hashed)
+			hash_remove(idx, c);
+	}
 	if (c->prev)
 		c->prev->next = c->next;
 	if (c->next)
@@ -851,6 +3564,13 @@ struct json *json_detach_item_from_array(struct json *array, int which)
 	return c;
 }
 
+struct json *json_detach_item_from_array(struct json *array, int which)
+{
+	struct json *c = json_get_array_item(array, which);
+
+	return c ? detach_child(array, c, which > 0 ? which : 0) : 0;
+}
+
 void json_delete_item_from_array(struct json *array, int which)
 {
 	json_delete(json_detach_item_from_array(array, which));
@@ -859,13 +3579,9 @@ void json_delete_item_from_array(struct json *array, int which)
 struct json *json_detach_item_from_object(struct json *object,
 					 const char *string)
 {
-	int i = 0;
-	struct json *c = object->child;
-	while (c && json_strcasecmp(c->string, string))
-		i++, c = c->next;
-	if (c)
-		return json_detach_item_from_array(object, i);
-	return 0;
+	struct json *c = object_find(object, string, 0);
+
+	return c ? detach_child(object, c, -1) : 0;
 }
 
 void json_delete_item_from_object(struct json *object, const char *string)
@@ -873,15 +3589,20 @@ void json_delete_item_from_object(struct json *object, const char *string)
 	json_delete(json_detach_item_from_object(object, string));
 }
 
-/* Replace array/object items with new ones. */
-void json_replace_item_in_array(struct json *array, int which,
-			      struct json *newitem)
+/* Put newitem in the place of child c, at position i (or -1). */
+static void replace_child(struct json *array, struct json *c, int i,
+			  struct json *newitem)
 {
-	struct json *c = array->child;
-	while (c && which > 0)
-		c = c->next, which--;
-	if (!c)
-		return;
+	struct json_index *idx = array->index;
+	int hashed = 0;
+
+	if (index_valid(array)) {
+		if (i < 0)
+			i = index_find(idx, c);
+		idx->items[i] = newitem;
+		if ((hashed = idx->hashed))
+			hash_remove(idx, c);
+	}
 	newitem->next = c->next;
 	newitem->prev = c->prev;
 	if (newitem->next)
@@ -892,18 +3613,28 @@ void json_replace_item_in_array(struct json *array, int which,
 		newitem->prev->next = newitem;
 	c->next = c->prev = 0;
 	json_delete(c);
+	if (hashed)
+		hash_insert(idx, newitem);
+}
+
+/* Replace array/object items with new ones. */
+void json_replace_item_in_array(struct json *array, int which,
+			      struct json *newitem)
+{
+	struct json *c = json_get_array_item(array, which);
+
+	if (c)
+		replace_child(array, c, which > 0 ? which : 0, newitem);
 }
 
 void json_replace_item_in_object(struct json *object, const char *string,
 			       struct json *newitem)
 {
-	int i = 0;
-	struct json *c = object->child;
-	while (c && json_strcasecmp(c->string, string))
-		i++, c = c->next;
+	struct json *c = object_find(object, string, 0);
+
 	if (c) {
-		newitem->string = json_strdup(string);
-		json_replace_item_in_array(object, i, newitem);
+		json_set_name(newitem, json_item_strdup(string));
+		replace_child(object, c, -1, newitem);
 	}
 }
 
@@ -943,11 +3674,24 @@ struct json *json_create_bool(int b)
 struct json *json_create_number(double num)
 {
 	struct json *item = json_new_item();
-	if (item) {
-		item->type = JSON_T_NUMBER;
-		item->valuedouble = num;
-		item->valueint = (int)num;
-	}
+	if (item)
+		set_number(item, double_to_int64(num), num);
+	return item;
+}
+
+struct json *json_create_int64(int64_t num)
+{
+	struct json *item = json_new_item();
+	if (item)
+		set_number(item, num, (double)num);
+	return item;
+}
+
+struct json *json_create_number_copy(const struct json *number)
+{
+	struct json *item = json_new_item();
+	if (item)
+		set_number(item, number->valueint64, number->valuedouble);
 	return item;
 }
 
@@ -956,7 +3700,7 @@ struct json *json_create_string(const char *string)
 	struct json *item = json_new_item();
 	if (item) {
 		item->type = JSON_T_STRING;
-		item->valuestring = json_strdup(string);
+		json_set_valuestring(item, json_item_strdup(string));
 	}
 	return item;
 }
@@ -977,63 +3721,106 @@ struct json *json_create_object()
 	return item;
 }
 
+struct json_raw *json_raw_new(const char *text, size_t len)
+{
+	struct json_raw *raw;
+
+	raw = (struct json_raw *)json_malloc(sizeof(*raw) + len + 1);
+	if (!raw)
+		return 0;
+	raw->refs = 1;
+	raw->len = len;
+	memcpy(raw->text, text, len);
+	raw->text[len] = 0;
+	return raw;
+}
+
+struct json_raw *json_raw_get(struct json_raw *raw)
+{
+	__atomic_add_fetch(&raw->refs, 1, __ATOMIC_RELAXED);
+	return raw;
+}
+
+void json_raw_put(struct json_raw *raw)
+{
+	if (raw && !__atomic_sub_fetch(&raw->refs, 1, __ATOMIC_ACQ_REL))
+		json_free(raw);
+}
+
+struct json *json_create_raw(const char *text, size_t len)
+{
+	struct json *item = json_new_item();
+	struct json_raw *raw;
+
+	if (!item)
+		return 0;
+	raw = (struct json_raw *)json_item_alloc(sizeof(*raw) + len + 1);
+	if (!raw) {
+		json_delete(item);
+		return 0;
+	}
+	raw->refs = 1;
+	raw->len = len;
+	memcpy(raw->text, text, len);
+	raw->text[len] = 0;
+	item->type = JSON_T_RAW;
+	json_set_valuestring(item, (char *)raw);
+	return item;
+}
+
+struct json *json_create_shared_raw(struct json_raw *raw)
+{
+	struct json *item = json_new_item();
+
+	if (!item)
+		return 0;
+	item->type = JSON_T_RAW;
+	item->valuestring = (char *)json_raw_get(raw);
+	item->flags |= JSON_F_SHARED;
+	return item;
+}
+
 /* Create Arrays: */
 struct json *json_create_int_array(int *numbers, int count)
 {
 	int i;
-	struct json *n = 0, *p = 0, *a = json_create_array();
-	for (i = 0; a && i < count; i++) {
-		n = json_create_number(numbers[i]);
-		if (!i)
-			a->child = n;
-		else
-			suffix_object(p, n);
-		p = n;
-	}
+	struct json *a = json_create_array();
+	if (a)
+		json_array_reserve(a, count);
+	for (i = 0; a && i < count; i++)
+		json_add_item_to_array(a, json_create_number(numbers[i]));
 	return a;
 }
 
 struct json *json_create_float_array(float *numbers, int count)
 {
 	int i;
-	struct json *n = 0, *p = 0, *a = json_create_array();
-	for (i = 0; a && i < count; i++) {
-		n = json_create_number(numbers[i]);
-		if (!i)
-			a->child = n;
-		else
-			suffix_object(p, n);
-		p = n;
-	}
+	struct json *a = json_create_array();
+	if (a)
+		json_array_reserve(a, count);
+	for (i = 0; a && i < count; i++)
+		json_add_item_to_array(a, json_create_number(numbers[i]));
 	return a;
 }
 
 struct json *json_create_double_array(double *numbers, int count)
 {
 	int i;
-	struct json *n = 0, *p = 0, *a = json_create_array();
-	for (i = 0; a && i < count; i++) {
-		n = json_create_number(numbers[i]);
-		if (!i)
-			a->child = n;
-		else
-			suffix_object(p, n);
-		p = n;
-	}
+	struct json *a = json_create_array();
+	if (a)
+		json_array_reserve(a, count);
+	for (i = 0; a && i < count; i++)
+		json_add_item_to_array(a, json_create_number(numbers[i]));
 	return a;
 }
 
 struct json *json_create_string_array(const char **strings, int count)
 {
 	int i;
-	struct json *n = 0, *p = 0, *a = json_create_array();
-	for (i = 0; a && i < count; i++) {
-		n = json_create_string(strings[i]);
-		if (!i)
-			a->child = n;
-		else
-			suffix_object(p, n);
-		p = n;
-	}
+	struct json *a = json_create_array();
+	if (a)
+		json_array_reserve(a, count);
+	for (i = 0; a && i < count; i++)
+		json_add_item_to_array(a, json_create_string(strings[i]));
 	return a;
 }
@@ -28,6 +28,9 @@
 #ifndef __json_h__
 #define __json_h__
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -40,23 +43,40 @@ extern "C" {
 #define JSON_T_STRING 4
 #define JSON_T_ARRAY 5
 #define JSON_T_OBJECT 6
+#define JSON_T_RAW 7	/* pre-rendered text, see json_create_raw() */
 
 #define JSON_T_IS_REFERENCE 256
 
+struct json_index;
+
 /* The json structure: */
 struct json {
 	struct json *next, *prev;	/* next/prev allow you to walk array/object chains. Alternatively, use GetArraySize/GetArrayItem/GetObjectItem */
 	struct json *child;	/* An array or object item will have a child pointer pointing to a chain of the items in the array/object. */
 
 	int type;		/* The type of the item, as above. */
+	int flags;		/* JSON_F_*, where the item's memory comes from and such. */
 
 	char *valuestring;	/* The item's string, if type==json_String */
 	int valueint;		/* The item's number, if type==json_Number */
 	double valuedouble;	/* The item's number, if type==json_Number */
+	int64_t valueint64;	/* The item's number, exact for integers that fit */
 
 	char *string;		/* The item's name string, if this item is the child of, or is in the list of subitems of an object. */
+
+	struct json_index *index;	/* An array or object may index its children, see json_array_reserve. */
 };
 
+/* The item itself / its valuestring / its name live in an arena (the
+ * strings may also live in an insitu parser's buffer). */
+#define JSON_F_ARENA 1
+#define JSON_F_ARENA_VALUE 2
+#define JSON_F_ARENA_NAME 4
+/* An array/object whose text hasn't been parsed yet, see json_expand(). */
+#define JSON_F_LAZY 8
+/* A JSON_T_RAW item's text is a counted struct json_raw. */
+#define JSON_F_SHARED 16
+
 struct json_hooks {
 	void *(*malloc_fn) (size_t sz);
 	void (*free_fn) (void *ptr);
@@ -65,6 +85,30 @@ struct json_hooks {
 /* Supply malloc, realloc and free functions to json */
 extern void json_init_hooks(struct json_hooks *hooks);
 
+/* Region allocator for items and their strings.  While an arena is bound
+ * (per thread), every item created, parsed or named is carved out of it and
+ * the whole lot is released at once by json_arena_reset(), which keeps the
+ * first block around so the arena can be reused for the next tree.
+ * json_delete() skips arena memory, so trees mixing both are fine.
+ * The blocks themselves come from json_malloc. */
+#define JSON_ARENA_BLOCK_SIZE 8192
+
+struct json_arena_block;
+
+struct json_arena {
+	struct json_arena_block *block;	/* current block, the rest chained behind */
+	size_t block_size;
+};
+
+extern void json_arena_init(struct json_arena *arena, size_t block_size);
+extern void *json_arena_alloc(struct json_arena *arena, size_t sz);
+extern void json_arena_reset(struct json_arena *arena);
+extern void json_arena_destroy(struct json_arena *arena);
+
+/* Make arena the one new items come from (NULL for json_malloc).
+ * Returns the previously bound arena. */
+extern struct json_arena *json_arena_bind(struct json_arena *arena);
+
 /* Supply a block of JSON, and this returns a json object you can interrogate.
  * Call json_Delete when finished. */
 extern struct json *json_parse(const char *value);
@@ -74,6 +118,192 @@ extern struct json *json_parse(const char *value);
  * end_ptr will point to 1 past the end of the JSON object */
 extern struct json *json_parse_stream(const char *value, char **end_ptr);
 
+/* Like json_parse(), but the strings are left in value (insitu, see below). */
+extern struct json *json_parse_insitu(char *value);
+
+/* Incremental parser, for input that arrives in pieces (e.g. from a socket).
+ * The caller keeps appending to one buffer and hands the whole of it to
+ * json_parser_feed() after every read; the parser remembers where it stopped,
+ * including any half-received token and the open arrays/objects, so each byte
+ * is scanned only once.  The buffer may be realloc'd between calls. */
+#define JSON_PARSE_ERROR -1
+#define JSON_PARSE_MORE 0
+#define JSON_PARSE_DONE 1
+
+struct json_parser_frame;
+
+/* Event callbacks (SAX style).  With p->events set the parser reports what
+ * it scans to them, with p->ctx, instead of building a value: nothing is
+ * allocated per element and json_parser_result() has nothing to return.
+ * Strings and member names come as str[0..len), unescaped; they only last
+ * for the call and aren't NUL terminated unless insitu.  Numbers come as
+ * both valueint64 and valuedouble would.  Any callback may be NULL, one
+ * returning nonzero stops the parse with JSON_PARSE_ERROR. */
+struct json_events {
+	int (*start_object)(void *ctx);
+	int (*end_object)(void *ctx);
+	int (*start_array)(void *ctx);
+	int (*end_array)(void *ctx);
+	int (*key)(void *ctx, const char *str, size_t len);
+	int (*string)(void *ctx, const char *str, size_t len);
+	int (*number)(void *ctx, int64_t i, double d);
+	int (*boolean)(void *ctx, int b);
+	int (*null)(void *ctx);
+};
+
+struct json_parser {
+	struct json *root;	/* value being built */
+	struct json_parser_frame *stack;	/* open arrays/objects */
+	int depth, stack_size;
+	int state;
+	int in_key, escaped;
+	int hex;		/* \u digits still expected */
+	const char *literal;
+	char *key;		/* member name waiting for its value */
+	int key_in_arena;
+	struct json_arena *arena;	/* build the value here, if set */
+	size_t pos;		/* offset of the next byte to scan (or of the error) */
+	size_t tok;		/* offset of the token being scanned */
+	size_t start;		/* offset of the value's first byte */
+	int insitu;		/* leave the strings in buf, see below */
+	char ***strings;	/* insitu: where the value refers to them */
+	int string_count, string_size;
+	const char *lazy;	/* leave arrays/objects under this name lazy */
+	int skim;		/* nesting inside a lazy array/object */
+	const struct json_events *events;	/* report to these, if set */
+	void *ctx;
+	char *scratch;		/* events: escaped strings are unescaped here */
+	size_t scratch_size;
+};
+
+/* With insitu set the parser writes to buf: strings are unescaped in place
+ * and NUL terminated over their closing quote, and the value refers to them
+ * there instead of to copies.  buf[start..pos) must then stay around as long
+ * as the value; json_parser_compact() keeps it while the value is being
+ * built, take the result before compacting again. */
+
+/* With lazy set, an array or object stored under a member of that name
+ * (e.g. "params") is only skimmed for its end, then kept as text in a
+ * JSON_F_LAZY item; the rest of the value is indexed as usual.  Errors in
+ * the skimmed text show up when it is expanded.  Insitu, the text stays in
+ * buf and is relocated along with the strings. */
+
+extern void json_parser_init(struct json_parser *p);
+extern void json_parser_reset(struct json_parser *p);
+extern void json_parser_destroy(struct json_parser *p);
+
+/* Scan buf[0..len). Returns JSON_PARSE_DONE when a complete value is ready,
+ * JSON_PARSE_MORE when more input is needed, JSON_PARSE_ERROR on bad input. */
+extern int json_parser_feed(struct json_parser *p, const char *buf, size_t len);
+
+/* Like json_parser_feed(), but buf[0..len) is all the input there is. */
+extern int json_parser_finish(struct json_parser *p, const char *buf, size_t len);
+
+/* Take the parsed value after JSON_PARSE_DONE and rearm the parser for the
+ * next value, which starts at p->pos. */
+extern struct json *json_parser_result(struct json_parser *p);
+
+/* Drop the bytes the parser no longer needs from the front of buf.
+ * Returns the new length of buf. */
+extern size_t json_parser_compact(struct json_parser *p, char *buf, size_t len);
+
+/* Insitu, after JSON_PARSE_DONE: copy the value's bytes buf[start..pos) to
+ * to and point its strings there, so buf can be reused. */
+extern void json_parser_relocate(struct json_parser *p, const char *buf,
+				 char *to);
+
+/* Output buffer for the serializer.  Zero it and the serializer grows it
+ * with json_malloc (release it with json_buffer_free()), or point data/size
+ * at memory of your own and set fixed. */
+struct json_buffer {
+	char *data;
+	size_t len, size;
+	int fixed;
+};
+
+/* Append the rendering of item to b; fmt selects the indented format.
+ * The output is NUL terminated, the NUL isn't counted in b->len.
+ * Returns 0, or -1 on failure (out of memory or room) leaving b as it was. */
+extern int json_print_append(struct json_buffer *b, struct json *item, int fmt);
+
+/* Render item into buf[0..size), returns its length or -1 if it doesn't fit. */
+extern int json_print_to_buffer(struct json *item, char *buf, size_t size,
+				int fmt);
+
+/* Append len raw bytes to b, NUL terminated. Returns 0 or -1. */
+extern int json_buffer_append(struct json_buffer *b, const char *data,
+			      size_t len);
+extern void json_buffer_free(struct json_buffer *b);
+
+/* Tape: a flat, read-only form of a value for readers that only walk it.
+ * The value is one array of tagged 64-bit words in document order, arrays
+ * and objects know their size and where they end so cursors step over
+ * them without looking inside, and the strings are copied one after the
+ * other into one buffer.  No items are built, and parsing into a tape
+ * again reuses its memory. */
+struct json_tape {
+	uint64_t *words;
+	size_t len, size;
+	struct json_buffer strings;
+	size_t *open;		/* building: the open arrays/objects */
+	int depth, open_size;
+};
+
+/* A value in a tape. */
+struct json_cursor {
+	const struct json_tape *tape;
+	size_t pos;
+};
+
+extern void json_tape_init(struct json_tape *t);
+extern void json_tape_reset(struct json_tape *t);
+extern void json_tape_destroy(struct json_tape *t);
+
+/* Events appending to the tape given as ctx, for building one with a
+ * json_parser of your own (reset the tape before each value). */
+extern const struct json_events json_tape_events;
+
+/* Parse buf[0..len) into t (e.g. params from json_get_raw()).
+ * Returns 0, or -1 on bad input. */
+extern int json_tape_parse(struct json_tape *t, const char *buf, size_t len);
+
+/* Like json_parse_stream(), into t. Returns 0 or -1. */
+extern int json_tape_parse_stream(struct json_tape *t, const char *value,
+				  char **end_ptr);
+
+/* Point c at the value in t. */
+extern void json_tape_root(const struct json_tape *t, struct json_cursor *c);
+
+/* JSON_T_* of the value at c. */
+extern int json_cursor_type(const struct json_cursor *c);
+extern double json_cursor_double(const struct json_cursor *c);
+extern int64_t json_cursor_int64(const struct json_cursor *c);
+
+/* A string value, NUL terminated, or NULL; len may be NULL. */
+extern const char *json_cursor_string(const struct json_cursor *c,
+				      size_t *len);
+
+/* The name of an object member, or NULL. */
+extern const char *json_cursor_name(const struct json_cursor *c);
+
+/* Elements of an array/object, 0 for anything else. */
+extern int json_cursor_size(const struct json_cursor *c);
+
+/* Point child at the first element of an array/object, then step it
+ * along with json_cursor_next().  Both return 0, or -1 when there is
+ * none and leave the cursor as it was. */
+extern int json_cursor_child(const struct json_cursor *c,
+			     struct json_cursor *child);
+extern int json_cursor_next(struct json_cursor *c);
+
+/* Like json_get_array_item()/json_get_object_item(): point out at the
+ * element, returns 0 or -1 if there is none. */
+extern int json_cursor_get_array_item(const struct json_cursor *c, int item,
+				      struct json_cursor *out);
+extern int json_cursor_get_object_item(const struct json_cursor *c,
+				       const char *string,
+				       struct json_cursor *out);
+
 /* Render a json entity to text for transfer/storage. Free the char* when finished. */
 extern char *json_sprint(struct json *item);
 
@@ -92,6 +322,25 @@ extern struct json *json_get_array_item(struct json *array, int item);
 
 /* Get item "string" from object. Case insensitive. */
 extern struct json *json_get_object_item(struct json *object, const char *string);
+/* Same, but the name must match exactly, which is cheaper. */
+extern struct json *json_get_object_item_case_sensitive(struct json *object,
+							const char *string);
+
+/* Parse the text of a lazy array/object into its children, into the arena
+ * it was parsed with (see json_set_lazy_arena()).  The json_get_* and the
+ * add/detach/replace calls do this on first use.  A reference to a lazy
+ * item can't be expanded, only printed.  Returns 0, or -1 if the text is
+ * bad, which leaves the item empty. */
+extern int json_expand(struct json *item);
+
+/* The text of a lazy array/object as it came in, NULL once expanded.
+ * Printing an unexpanded item copies this out verbatim, so it can be
+ * forwarded without parsing it at all. */
+extern const char *json_get_raw(struct json *item, size_t *len);
+
+/* Expand lazy item into arena from now on, e.g. when the arena it was
+ * parsed into has been handed over to another owner. */
+extern void json_set_lazy_arena(struct json *item, struct json_arena *arena);
 
 /* These calls create a json item of the appropriate type. */
 extern struct json *json_create_null(void);
@@ -99,16 +348,41 @@ extern struct json *json_create_true(void);
 extern struct json *json_create_false(void);
 extern struct json *json_create_bool(int b);
 extern struct json *json_create_number(double num);
+extern struct json *json_create_int64(int64_t num);
+/* The same number as a parsed one, both as an exact integer and a double. */
+extern struct json *json_create_number_copy(const struct json *number);
 extern struct json *json_create_string(const char *string);
 extern struct json *json_create_array(void);
 extern struct json *json_create_object(void);
 
+/* A JSON_T_RAW item holds text that is already valid JSON, the serializer
+ * copies it out as is (it isn't checked, nor indented).  Handy for large
+ * results that rarely change: render them once and splice them in.
+ * json_create_raw() copies text[0..len) into the item. */
+extern struct json *json_create_raw(const char *text, size_t len);
+
+/* Shared raw text, for a fragment that goes out in many trees without
+ * being copied into each.  json_raw_new() returns it with one reference,
+ * held by the caller; json_create_shared_raw() takes another for the item,
+ * dropped when the item is deleted, so the text can be replaced (new one,
+ * put the old one) while trees still refer to it.  The count is atomic. */
+struct json_raw;
+
+extern struct json_raw *json_raw_new(const char *text, size_t len);
+extern struct json_raw *json_raw_get(struct json_raw *raw);
+extern void json_raw_put(struct json_raw *raw);
+extern struct json *json_create_shared_raw(struct json_raw *raw);
+
 /* These utilities create an Array of count items. */
 extern struct json *json_create_int_array(int *numbers, int count);
 extern struct json *json_create_float_array(float *numbers, int count);
 extern struct json *json_create_double_array(double *numbers, int count);
 extern struct json *json_create_string_array(const char **strings, int count);
 
+/* Make room for count more items in array/object, so building a large one
+ * doesn't have to grow its child index.  Appending is O(1) either way. */
+extern int json_array_reserve(struct json *array, int count);
+
 /* Append item to the specified array/object. */
 extern void json_add_item_to_array(struct json *array, struct json *item);
 extern void json_add_item_to_object(struct json *object,
@@ -138,8 +412,8 @@ extern void json_replace_item_in_object(struct json *object,
 					const char *string,
 					struct json *newitem);
 
-void *(*json_malloc) (size_t sz);
-void (*json_free) (void *ptr);
+extern void *(*json_malloc) (size_t sz);
+extern void (*json_free) (void *ptr);
 
 #define json_add_null_to_object(object,name)     json_add_item_to_object(object, name, json_create_null())
 #define json_add_true_to_object(object,name)     json_add_item_to_object(object, name, json_create_true())
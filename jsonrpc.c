@@ -12,19 +12,24 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netdb.h>
+#include <poll.h>
 #include <arpa/inet.h>
 
 #include "jsonrpc.h"
 
 static int __jrpc_server_start(struct jrpc_server *server);
 static void jrpc_procedure_destroy(struct jrpc_procedure *procedure);
-
-struct ev_loop *loop;
+static struct jrpc_procedure *procedure_lookup(struct jrpc_server *server,
+					       const char *name,
+					       struct jrpc_lookup_stats *stats);
 
 // get sockaddr, IPv4 or IPv6:
 static void *get_in_addr(struct sockaddr *sa)
@@ -35,26 +40,189 @@ static void *get_in_addr(struct sockaddr *sa)
 	return &(((struct sockaddr_in6 *)sa)->sin6_addr);
 }
 
-static int send_request(struct jrpc_connection *conn, char *request)
+// queue data on the connection, it goes out with the next flush_output()
+static int append_output(struct jrpc_connection *conn, const char *data,
+			 size_t len)
 {
-	int fd = conn->fd;
-	if (conn->debug_level > 1)
-		printf("JSON Request:\n%s\n", request);
-	write(fd, request, strlen(request));
-	write(fd, "\n", 1);
+	struct jrpc_output *b = conn->out_tail;
+	size_t n, size;
+
+	while (len) {
+		if (!b || b->len == b->size) {
+			size = len > JRPC_OUTPUT_CHUNK ? len : JRPC_OUTPUT_CHUNK;
+			b = malloc(sizeof(struct jrpc_output) + size);
+			if (b == NULL) {
+				perror("Memory error");
+				return -ENOMEM;
+			}
+			b->next = NULL;
+			b->off = b->len = 0;
+			b->size = size;
+			if (conn->out_tail)
+				conn->out_tail->next = b;
+			else
+				conn->out_head = b;
+			conn->out_tail = b;
+		}
+		n = b->size - b->len;
+		if (n > len)
+			n = len;
+		memcpy(b->data + b->len, data, n);
+		b->len += n;
+		conn->out_len += n;
+		data += n;
+		len -= n;
+	}
 	return 0;
 }
 
-static int send_response(struct jrpc_connection *conn, char *response)
+static void free_output(struct jrpc_connection *conn)
 {
-	int fd = conn->fd;
-	if (conn->debug_level > 1)
-		printf("JSON Response:\n%s\n", response);
-	write(fd, response, strlen(response));
-	write(fd, "\n", 1);
+	struct jrpc_output *b;
+
+	while ((b = conn->out_head)) {
+		conn->out_head = b->next;
+		free(b);
+	}
+	conn->out_tail = NULL;
+	conn->out_len = 0;
+}
+
+// write as much pending output as the socket takes, flags are added to
+// the sendmsg() ones. Returns 0 once everything is out, 1 if the socket
+// is full, <0 on error.
+static int __flush_output(struct jrpc_connection *conn, int flags)
+{
+	struct iovec iov[16];
+	struct msghdr msg;
+	struct jrpc_output *b;
+	ssize_t n;
+	int i;
+
+	while (conn->out_len) {
+		for (i = 0, b = conn->out_head; b && i < 16; b = b->next) {
+			if (b->len == b->off)
+				continue;
+			iov[i].iov_base = b->data + b->off;
+			iov[i++].iov_len = b->len - b->off;
+		}
+		// a peer gone away is an error here, not a SIGPIPE
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = i;
+		if ((n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL | flags)) == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 1;
+			perror("write");
+			return -EIO;
+		}
+		conn->out_len -= n;
+		while ((b = conn->out_head) && n >= b->len - b->off) {
+			n -= b->len - b->off;
+			if (b == conn->out_tail) {
+				// keep the last chunk around for the next response
+				b->off = b->len = 0;
+				break;
+			}
+			conn->out_head = b->next;
+			free(b);
+		}
+		if (n)
+			conn->out_head->off += n;
+	}
+	return 0;
+}
+
+static int flush_output(struct jrpc_connection *conn)
+{
+	return __flush_output(conn, 0);
+}
+
+static void job_link(struct jrpc_job **head, struct jrpc_job **tail,
+		     struct jrpc_job *job)
+{
+	if (*tail)
+		(*tail)->next = job;
+	else
+		*head = job;
+	*tail = job;
+}
+
+// a response kept as bytes until it can go out
+static struct jrpc_job *held_job(const char *data, size_t len, int newline)
+{
+	struct jrpc_job *job = calloc(1, sizeof(struct jrpc_job));
+
+	if (job == NULL || (job->data = malloc(len + newline)) == NULL) {
+		free(job);
+		perror("Memory error");
+		return NULL;
+	}
+	memcpy(job->data, data, len);
+	if (newline)
+		job->data[len] = '\n';
+	job->len = len + newline;
+	job->done = 1;
+	return job;
+}
+
+// route a rendered message: to the job capturing it, into the batch
+// being answered, behind pending pooled requests, or to the output
+static int send_output(struct jrpc_connection *conn, const char *data,
+		       size_t len)
+{
+	struct json_buffer *b = &conn->bbuf;
+	struct jrpc_job *job;
+
+	if ((job = conn->capture)) {
+		if ((job->data = malloc(len)) == NULL)
+			return -ENOMEM;
+		memcpy(job->data, data, len);
+		job->len = len;
+		return 0;
+	}
+	if (conn->batch && !conn->batch_job) {
+		if ((b->len > 1 && json_buffer_append(b, ",", 1)) ||
+		    json_buffer_append(b, data, len))
+			return -ENOMEM;
+		return 0;
+	}
+	if (conn->batch || (conn->jobs_head && !conn->draining)) {
+		if ((job = held_job(data, len, !conn->batch)) == NULL)
+			return -ENOMEM;
+		if (conn->batch)
+			job_link(&conn->batch_job->children,
+				 &conn->batch_job->children_tail, job);
+		else
+			job_link(&conn->jobs_head, &conn->jobs_tail, job);
+		return 0;
+	}
+	if (append_output(conn, data, len) || append_output(conn, "\n", 1))
+		return -ENOMEM;
 	return 0;
 }
 
+// render msg without any formatting and queue it, newline terminated
+static int queue_message(struct jrpc_connection *conn, struct json *msg,
+			 const char *what)
+{
+	struct json_buffer *b = &conn->wbuf;
+
+	b->len = 0;
+	if (json_print_append(b, msg, 0))
+		return -ENOMEM;
+	if (conn->debug_level > 1)
+		printf("JSON %s:\n%s\n", what, b->data);
+	return send_output(conn, b->data, b->len);
+}
+
+static int send_response(struct jrpc_connection *conn, struct json *response)
+{
+	return queue_message(conn, response, "Response");
+}
+
 static int send_error(struct jrpc_connection *conn, int code, char *message,
 		      struct json *id)
 {
@@ -65,9 +233,7 @@ static int send_error(struct jrpc_connection *conn, int code, char *message,
 	json_add_string_to_object(error_root, "message", message);
 	json_add_item_to_object(result_root, "error", error_root);
 	json_add_item_to_object(result_root, "id", id);
-	char *str_result = json_sprint(result_root);
-	return_value = send_response(conn, str_result);
-	json_free(str_result);
+	return_value = send_response(conn, result_root);
 	json_delete(result_root);
 	free(message);
 	return return_value;
@@ -82,42 +248,362 @@ static int send_result(struct jrpc_connection *conn, struct json *result,
 		json_add_item_to_object(result_root, "result", result);
 	json_add_item_to_object(result_root, "id", id);
 
-	char *str_result = json_sprint(result_root);
-	return_value = send_response(conn, str_result);
-	json_free(str_result);
+	return_value = send_response(conn, result_root);
 	json_delete(result_root);
 	return return_value;
 }
 
+// the request's strings point into conn->buffer, which is reused before
+// the pool is done with them: copy its bytes into the request's arena
+static int relocate_request(struct jrpc_connection *conn)
+{
+	struct json_parser *p = &conn->parser;
+	char *to;
+
+	if (!p->insitu)
+		return 0;
+	if ((to = json_arena_alloc(&conn->arena, p->pos - p->start)) == NULL)
+		return -ENOMEM;
+	json_parser_relocate(p, conn->buffer, to);
+	return 0;
+}
+
+// the batch being answered takes over from here, starting with the
+// answers collected so far
+static struct jrpc_job *batch_job(struct jrpc_connection *conn)
+{
+	struct json_buffer *b = &conn->bbuf;
+	struct jrpc_job *batch, *job;
+
+	if (conn->batch_job)
+		return conn->batch_job;
+	if (relocate_request(conn) ||
+	    (batch = calloc(1, sizeof(struct jrpc_job))) == NULL)
+		return NULL;
+	if (b->len > 1) {
+		if ((job = held_job(b->data + 1, b->len - 1, 0)) == NULL) {
+			free(batch);
+			return NULL;
+		}
+		job_link(&batch->children, &batch->children_tail, job);
+	}
+	batch->conn = conn;
+	return conn->batch_job = batch;
+}
+
+// a job for a request answered off the reading path. A single request
+// takes its arena along, batch elements get one of their own: the batch
+// keeps the request
+static struct jrpc_job *new_job(struct jrpc_connection *conn,
+				struct jrpc_procedure *procedure,
+				struct json *params, struct json *id)
+{
+	struct jrpc_job *job = calloc(1, sizeof(struct jrpc_job));
+	struct jrpc_job *batch = NULL;
+
+	if (job == NULL || (conn->batch ? !(batch = batch_job(conn))
+			    : relocate_request(conn) < 0)) {
+		free(job);
+		perror("Memory error");
+		return NULL;
+	}
+	job->conn = conn;
+	job->procedure = procedure;
+	job->params = params;
+	job->id = id;
+	if (batch)
+		json_arena_init(&job->arena, 0);
+	else {
+		job->arena = conn->arena;
+		json_arena_init(&conn->arena, 0);
+	}
+	job->ctx.data = procedure->data;
+	job->ctx.arena = &job->arena;
+	if (procedure->flags & JRPC_PROCEDURE_ASYNC) {
+		job->ctx.token = job;
+		job->holds = 2;
+	}
+	if (params)
+		json_set_lazy_arena(params, &job->arena);
+
+	if (batch) {
+		job->batch = batch;
+		job_link(&batch->children, &batch->children_tail, job);
+		batch->pending++;
+	} else
+		job_link(&conn->jobs_head, &conn->jobs_tail, job);
+	conn->pooled++;
+	return job;
+}
+
+// hand the request over to the pool
+static int submit_job(struct jrpc_server *server,
+		      struct jrpc_connection *conn,
+		      struct jrpc_procedure *procedure, struct json *params,
+		      struct json *id)
+{
+	struct jrpc_pool *pool = &server->pool;
+	struct jrpc_job *job = new_job(conn, procedure, params, id);
+
+	if (job == NULL)
+		return send_error(conn, JRPC_INTERNAL_ERROR,
+				  strdup("Out of memory."), id);
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->tail)
+		pool->tail->queue_next = job;
+	else
+		pool->head = job;
+	pool->tail = job;
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+	return 0;
+}
+
+static void job_free(struct jrpc_job *job)
+{
+	struct jrpc_job *child;
+
+	while ((child = job->children)) {
+		job->children = child->next;
+		job_free(child);
+	}
+	if (job->procedure) {
+		json_delete(job->result);
+		free(job->ctx.error_message);
+		free(job->message);
+	}
+	json_arena_destroy(&job->arena);
+	free(job->data);
+	free(job);
+}
+
+// send the answer of a job the pool is done with
+static int job_respond(struct jrpc_connection *conn, struct jrpc_job *job)
+{
+	int ret;
+
+	if (!job->id)
+		return 0;	// a notification, job_free() drops the result
+
+	if (job->ctx.error_code) {
+		ret = send_error(conn, job->ctx.error_code,
+				 job->ctx.error_message, job->id);
+		job->ctx.error_message = NULL;
+	} else {
+		ret = send_result(conn, job->result, job->id);
+		job->result = NULL;
+	}
+	return ret;
+}
+
+// join the answers of a batch once the last pooled element is back
+static void batch_finish(struct jrpc_job *batch)
+{
+	struct jrpc_job *child;
+	size_t len = 2;
+	char *p;
+
+	batch->done = 1;
+	for (child = batch->children; child; child = child->next)
+		if (child->len)
+			len += child->len + 1;
+	// nothing to say when the batch held notifications only
+	if (len == 2 || batch->conn->dead ||
+	    (batch->data = malloc(len)) == NULL)
+		return;
+	p = batch->data;
+	*p++ = '[';
+	for (child = batch->children; child; child = child->next) {
+		if (!child->len)
+			continue;
+		if (p != batch->data + 1)
+			*p++ = ',';
+		memcpy(p, child->data, child->len);
+		p += child->len;
+	}
+	*p++ = ']';
+	*p++ = '\n';
+	batch->len = p - batch->data;
+}
+
+#define JRPC_BAD_PARAMS "Parse error. Invalid JSON was received in params."
+
+// params stay unparsed up to here, so unknown methods never pay for them;
+// only JRPC_PROCEDURE_LAZY handlers get them that way
+static int expand_params(struct jrpc_procedure *procedure, struct json *params)
+{
+	if (!params || (procedure->flags & JRPC_PROCEDURE_LAZY))
+		return 0;
+	return json_expand(params);
+}
+
+// feed a streaming procedure's params to its events, from their text; the
+// rare params that were expanded after all are rendered for it
+static void stream_params(struct jrpc_procedure *procedure,
+			  struct jrpc_context *ctx, struct json *params)
+{
+	struct json_buffer b = { 0 };
+	struct json_parser parser;
+	const char *text;
+	size_t len;
+	int ret = JSON_PARSE_ERROR;
+
+	if (!params)
+		return;
+	if (!(text = json_get_raw(params, &len))) {
+		if (json_print_append(&b, params, 0) == 0) {
+			text = b.data;
+			len = b.len;
+		}
+	}
+	if (text) {
+		json_parser_init(&parser);
+		parser.events = procedure->events;
+		parser.ctx = ctx;
+		ret = json_parser_finish(&parser, text, len);
+		json_parser_destroy(&parser);
+	}
+	json_buffer_free(&b);
+	if (ret != JSON_PARSE_DONE && !ctx->error_code) {
+		ctx->error_code = JRPC_PARSE_ERROR;
+		ctx->error_message = strdup(JRPC_BAD_PARAMS);
+	}
+}
+
+// run the procedure of a job, on the pool or (async ones) on the loop
+static struct json *job_run(struct jrpc_job *job)
+{
+	struct jrpc_procedure *procedure = job->procedure;
+
+	if (procedure->events)
+		stream_params(procedure, &job->ctx, job->params);
+	else if (expand_params(procedure, job->params)) {
+		job->ctx.error_code = JRPC_PARSE_ERROR;
+		job->ctx.error_message = strdup(JRPC_BAD_PARAMS);
+		return NULL;
+	}
+	return procedure->function(&job->ctx, job->params, job->id);
+}
+
+// give a job that is done back to its connection's worker
+static void job_done(struct jrpc_job *job)
+{
+	struct jrpc_worker *worker = job->conn->worker;
+
+	// signalled under the lock: the worker may go away right after,
+	// async calls aren't necessarily answered by threads it joins
+	pthread_mutex_lock(&worker->done_lock);
+	job->queue_next = worker->done;
+	worker->done = job;
+	ev_async_send(worker->loop, &worker->done_watcher);
+	pthread_mutex_unlock(&worker->done_lock);
+}
+
+// an async call is done once both its handler has returned and it has
+// been answered, in either order and maybe on different threads
+static void job_release(struct jrpc_job *job)
+{
+	if (__atomic_sub_fetch(&job->holds, 1, __ATOMIC_ACQ_REL))
+		return;
+	if (job->code) {
+		job->ctx.error_code = job->code;
+		job->ctx.error_message = job->message;
+		job->message = NULL;
+	}
+	job_done(job);
+}
+
+// the handler returned: that answers the call, unless an async one was
+// left pending
+static void job_returned(struct jrpc_job *job, struct json *returned)
+{
+	if (!job->ctx.token || returned || job->ctx.error_code) {
+		job->result = returned;
+		job_done(job);
+	} else
+		job_release(job);
+}
+
+void jrpc_complete(struct jrpc_job *token, struct json *result)
+{
+	token->result = result;
+	job_release(token);
+}
+
+void jrpc_fail(struct jrpc_job *token, int code, const char *message)
+{
+	token->code = code;
+	token->message = strdup(message);
+	job_release(token);
+}
+
+// run an async procedure on the loop, its job keeps the request
+static int invoke_async(struct jrpc_connection *conn,
+			struct jrpc_procedure *procedure,
+			struct json *params, struct json *id)
+{
+	struct jrpc_job *job = new_job(conn, procedure, params, id);
+	struct json_arena *arena;
+	struct json *returned;
+
+	if (job == NULL)
+		return send_error(conn, JRPC_INTERNAL_ERROR,
+				  strdup("Out of memory."), id);
+	arena = json_arena_bind(NULL);
+	returned = job_run(job);
+	json_arena_bind(arena);
+	job_returned(job, returned);
+	return 0;
+}
+
 static int invoke_procedure(struct jrpc_server *server,
 			    struct jrpc_connection *conn, char *name,
 			    struct json *params, struct json *id)
 {
 	struct json *returned = NULL;
-	int procedure_found = 0;
-	struct jrpc_context ctx;
-	ctx.error_code = 0;
-	ctx.error_message = NULL;
-	int i = server->procedure_count;
-	while (i--) {
-		if (!strcmp(server->procedures[i].name, name)) {
-			procedure_found = 1;
-			ctx.data = server->procedures[i].data;
-			returned =
-			    server->procedures[i].function(&ctx, params, id);
-			break;
-		}
-	}
-	if (!procedure_found)
+	struct json_arena *arena;
+	struct jrpc_procedure *procedure;
+	struct jrpc_context ctx = { 0 };
+	ctx.arena = &conn->arena;
+
+	procedure = procedure_lookup(server, name, &conn->worker->lookup_stats);
+	if (!procedure) {
+		// a notification is not answered, not even with an error
+		if (!id)
+			return 0;
 		return send_error(conn, JRPC_METHOD_NOT_FOUND,
 				  strdup("Method not found."), id);
-	else {
-		if (ctx.error_code)
-			return send_error(conn, ctx.error_code,
-					  ctx.error_message, id);
-		else
-			return send_result(conn, returned, id);
 	}
+	if ((procedure->flags & JRPC_PROCEDURE_POOL) && server->pool.size)
+		return submit_job(server, conn, procedure, params, id);
+	if (procedure->flags & JRPC_PROCEDURE_ASYNC)
+		return invoke_async(conn, procedure, params, id);
+	if (!procedure->events && expand_params(procedure, params)) {
+		if (!id)
+			return 0;
+		return send_error(conn, JRPC_PARSE_ERROR,
+				  strdup(JRPC_BAD_PARAMS), id);
+	}
+
+	ctx.data = procedure->data;
+	// handlers allocate from the heap unless they bind ctx.arena
+	arena = json_arena_bind(NULL);
+	if (procedure->events)
+		stream_params(procedure, &ctx, params);
+	returned = procedure->function(&ctx, params, id);
+	json_arena_bind(arena);
+
+	if (!id) {
+		// a notification: nothing is rendered or written
+		json_delete(returned);
+		free(ctx.error_message);
+		return 0;
+	}
+	if (ctx.error_code)
+		return send_error(conn, ctx.error_code, ctx.error_message, id);
+	else
+		return send_result(conn, returned, id);
 }
 
 static int invoke_procedure_id(struct jrpc_server *server, struct json *method,
@@ -129,7 +615,7 @@ static int invoke_procedure_id(struct jrpc_server *server, struct json *method,
 	if (id != NULL)
 		id_copy = (id->type == JSON_T_STRING)
 		    ? json_create_string(id->valuestring)
-		    : json_create_number(id->valueint);
+		    : json_create_number_copy(id);
 	if (server->debug_level)
 		printf("Method Invoked: %s\n", method->valuestring);
 	return invoke_procedure(server, conn, method->valuestring, params,
@@ -140,13 +626,13 @@ static int eval_request(struct jrpc_server *server,
 			struct jrpc_connection *conn, struct json *root)
 {
 	struct json *method, *params, *id;
-	method = json_get_object_item(root, "method");
+	method = json_get_object_item_case_sensitive(root, "method");
 
 	if (method != NULL && method->type == JSON_T_STRING) {
-		params = json_get_object_item(root, "params");
+		params = json_get_object_item_case_sensitive(root, "params");
 		if (params == NULL || params->type == JSON_T_ARRAY
 		    || params->type == JSON_T_OBJECT) {
-			id = json_get_object_item(root, "id");
+			id = json_get_object_item_case_sensitive(root, "id");
 			if (id == NULL || id->type == JSON_T_STRING
 			    || id->type == JSON_T_NUMBER) {
 				return invoke_procedure_id(server, method, conn,
@@ -161,22 +647,171 @@ static int eval_request(struct jrpc_server *server,
 	return -1;
 }
 
+// answer the elements of a batch in one array, see
+// http://www.jsonrpc.org/specification#batch
+static int eval_batch(struct jrpc_server *server,
+		      struct jrpc_connection *conn, struct json *root)
+{
+	struct json_buffer *b = &conn->bbuf;
+	struct jrpc_job *batch;
+	struct json *item;
+
+	if (!root->child)
+		return send_error(conn, JRPC_INVALID_REQUEST,
+				  strdup("The JSON sent is not a valid"
+					 " Request object."), NULL);
+
+	b->len = 0;
+	if (json_buffer_append(b, "[", 1))
+		return -ENOMEM;
+	conn->batch = 1;
+	for (item = root->child; item; item = item->next) {
+		if (item->type == JSON_T_OBJECT)
+			eval_request(server, conn, item);
+		else
+			send_error(conn, JRPC_INVALID_REQUEST,
+				   strdup("The JSON sent is not a valid"
+					  " Request object."), NULL);
+	}
+	conn->batch = 0;
+
+	if ((batch = conn->batch_job)) {
+		// pooled elements still run on the request, the batch keeps it
+		conn->batch_job = NULL;
+		batch->arena = conn->arena;
+		json_arena_init(&conn->arena, 0);
+		job_link(&conn->jobs_head, &conn->jobs_tail, batch);
+		return 0;
+	}
+	if (b->len == 1)
+		return 0;
+	if (json_buffer_append(b, "]", 1))
+		return -ENOMEM;
+	return send_output(conn, b->data, b->len);
+}
+
 static void close_connection(struct ev_loop *loop, ev_io * w)
 {
-	ev_io_stop(loop, w);
-	close(((struct jrpc_connection *)w)->fd);
-	free(((struct jrpc_connection *)w)->buffer);
-	free(((struct jrpc_connection *)w));
+	struct jrpc_connection *conn = (struct jrpc_connection *)w;
+
+	ev_io_stop(loop, &conn->io);
+	ev_io_stop(loop, &conn->write_io);
+	close(conn->fd);
+	json_parser_destroy(&conn->parser);
+	json_arena_destroy(&conn->arena);
+	json_buffer_free(&conn->wbuf);
+	json_buffer_free(&conn->bbuf);
+	free_output(conn);
+	free(conn->buffer);
+	conn->buffer = NULL;
+	if (conn->jobs_head) {
+		// the pool still works on its requests
+		conn->dead = 1;
+		return;
+	}
+	free(conn);
+}
+
+// arm the write watcher while output is pending and stop reading from a
+// peer that doesn't drain its responses. May close the connection.
+static void update_watchers(struct ev_loop *loop, struct jrpc_connection *conn)
+{
+	if (conn->out_len)
+		ev_io_start(loop, &conn->write_io);
+	else
+		ev_io_stop(loop, &conn->write_io);
+
+	if (conn->closing) {
+		ev_io_stop(loop, &conn->io);
+		if (!conn->out_len && !conn->jobs_head)
+			close_connection(loop, &conn->io);
+	} else if (conn->out_len >= JRPC_OUTPUT_HIGH_WATERMARK
+		   || conn->pooled >= JRPC_POOL_CONNECTION_MAX)
+		ev_io_stop(loop, &conn->io);
+	else if (conn->out_len <= JRPC_OUTPUT_LOW_WATERMARK)
+		ev_io_start(loop, &conn->io);
+}
+
+static void write_cb(struct ev_loop *loop, ev_io * w, int revents)
+{
+	struct jrpc_connection *conn = (struct jrpc_connection *)
+	    ((char *)w - offsetof(struct jrpc_connection, write_io));
+
+	if (flush_output(conn) < 0)
+		return close_connection(loop, &conn->io);
+	update_watchers(loop, conn);
+}
+
+// write out the responses at the head of the connection that are ready
+static void release_jobs(struct ev_loop *loop, struct jrpc_connection *conn)
+{
+	struct jrpc_job *job;
+
+	conn->draining = 1;
+	while ((job = conn->jobs_head) && job->done) {
+		if (!(conn->jobs_head = job->next))
+			conn->jobs_tail = NULL;
+		if (conn->dead)
+			;
+		else if (!job->procedure)
+			append_output(conn, job->data, job->len);
+		else
+			job_respond(conn, job);
+		job_free(job);
+	}
+	conn->draining = 0;
+
+	if (conn->dead) {
+		if (!conn->jobs_head)
+			free(conn);
+		return;
+	}
+	if (flush_output(conn) < 0)
+		return close_connection(loop, &conn->io);
+	update_watchers(loop, conn);
+}
+
+static void done_cb(struct ev_loop *loop, ev_async * w, int revents)
+{
+	struct jrpc_worker *worker = (struct jrpc_worker *)((char *)w -
+			offsetof(struct jrpc_worker, done_watcher));
+	struct jrpc_connection *conn;
+	struct jrpc_job *job, *next, *batch;
+
+	pthread_mutex_lock(&worker->done_lock);
+	job = worker->done;
+	worker->done = NULL;
+	pthread_mutex_unlock(&worker->done_lock);
+
+	for (; job; job = next) {
+		next = job->queue_next;
+		conn = job->conn;
+		job->done = 1;
+		conn->pooled--;
+		if ((batch = job->batch)) {
+			// render it in place, the batch goes out as a whole
+			if (!conn->dead) {
+				conn->capture = job;
+				job_respond(conn, job);
+				conn->capture = NULL;
+			}
+			if (--batch->pending)
+				continue;
+			batch_finish(batch);
+		}
+		release_jobs(loop, conn);
+	}
 }
 
 static void connection_cb(struct ev_loop *loop, ev_io * w, int revents)
 {
 	struct json *root;
-	int fd, max_read_size;
+	struct json_arena *arena;
+	int fd, max_read_size, ret;
 	struct jrpc_connection *conn;
 	struct jrpc_server *server = (struct jrpc_server *)w->data;
 	size_t bytes_read = 0;
-	char *str_result, *new_buffer, *end_ptr = NULL;
+	char *str_result, *new_buffer;
 
 	//get our 'subclassed' event watcher
 	conn = (struct jrpc_connection *)w;
@@ -190,65 +825,80 @@ static void connection_cb(struct ev_loop *loop, ev_io * w, int revents)
 			return close_connection(loop, w);
 		}
 		conn->buffer = new_buffer;
-		memset(conn->buffer + conn->pos, 0,
-		       conn->buffer_size - conn->pos);
 	}
 	// can not fill the entire buffer, string must be NULL terminated
 	max_read_size = conn->buffer_size - conn->pos - 1;
 	if ((bytes_read = read(fd, conn->buffer + conn->pos, max_read_size))
 	    == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return;
 		perror("read");
 		return close_connection(loop, w);
 	}
 	if (!bytes_read) {
-		// client closed the sending half of the connection
+		// client closed the sending half of the connection,
+		// close ours once the pending responses are out
 		if (server->debug_level)
 			printf("Client closed connection.\n");
-		return close_connection(loop, w);
+		conn->closing = 1;
+		return update_watchers(loop, conn);
 	}
 
 	conn->pos += bytes_read;
+	conn->buffer[conn->pos] = '\0';
 
-	if ((root = json_parse_stream(conn->buffer, &end_ptr)) != NULL) {
+	// handle every complete request in the buffer, their responses
+	// are collected and written out together
+	while ((ret = json_parser_feed(&conn->parser, conn->buffer,
+				       conn->pos)) == JSON_PARSE_DONE) {
+		root = json_parser_result(&conn->parser);
 		if (server->debug_level > 1) {
 			str_result = json_sprint(root);
 			printf("Valid JSON Received:\n%s\n", str_result);
 			json_free(str_result);
 		}
 
-		if (root->type == JSON_T_OBJECT) {
+		arena = json_arena_bind(&conn->arena);
+		if (root->type == JSON_T_OBJECT)
 			eval_request(server, conn, root);
-		}
-		//shift processed request, discarding it
-		memmove(conn->buffer, end_ptr, strlen(end_ptr) + 2);
-
-		conn->pos = strlen(end_ptr);
-		memset(conn->buffer + conn->pos, 0,
-		       conn->buffer_size - conn->pos - 1);
+		else if (root->type == JSON_T_ARRAY)
+			eval_batch(server, conn, root);
+		else
+			send_error(conn, JRPC_INVALID_REQUEST,
+				   strdup("The JSON sent is not a valid"
+					  " Request object."), NULL);
+		json_arena_bind(arena);
+		// the request was parsed into the arena, drop it in one go
+		json_arena_reset(&conn->arena);
+	}
 
-		json_delete(root);
-	} else {
-		// did we parse the all buffer? If so, just wait for more.
-		// else there was an error before the buffer's end
-		if (end_ptr != (conn->buffer + conn->pos)) {
-			if (server->debug_level) {
-				printf("INVALID JSON Received:\n---\n%s\n---\n",
-				       conn->buffer);
-			}
-			send_error(conn, JRPC_PARSE_ERROR,
-				   strdup("Parse error. Invalid JSON"
-					  " was received by the server."),
-				   NULL);
-			return close_connection(loop, w);
+	if (ret == JSON_PARSE_ERROR) {
+		if (server->debug_level) {
+			printf("INVALID JSON Received:\n---\n%s\n---\n",
+			       conn->buffer);
 		}
+		send_error(conn, JRPC_PARSE_ERROR,
+			   strdup("Parse error. Invalid JSON"
+				  " was received by the server."),
+			   NULL);
+		conn->closing = 1;
 	}
 
+	// discard what has been parsed, keeping a partial token if any
+	conn->pos = json_parser_compact(&conn->parser, conn->buffer, conn->pos);
+	conn->buffer[conn->pos] = '\0';
+
+	if (flush_output(conn) < 0)
+		return close_connection(loop, w);
+	update_watchers(loop, conn);
 }
 
 static void accept_cb(struct ev_loop *loop, ev_io * w, int revents)
 {
 	char s[INET6_ADDRSTRLEN];
 	struct jrpc_connection *connection_watcher;
+	struct jrpc_worker *worker = (struct jrpc_worker *)((char *)w -
+			offsetof(struct jrpc_worker, listen_watcher));
 	connection_watcher = malloc(sizeof(struct jrpc_connection));
 	struct sockaddr_storage their_addr;	// connector's address information
 	socklen_t sin_size;
@@ -256,7 +906,9 @@ static void accept_cb(struct ev_loop *loop, ev_io * w, int revents)
 	connection_watcher->fd = accept(w->fd, (struct sockaddr *)&their_addr,
 					&sin_size);
 	if (connection_watcher->fd == -1) {
-		perror("accept");
+		// another worker sharing the socket may have taken it
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			perror("accept");
 		free(connection_watcher);
 	} else {
 		if (((struct jrpc_server *)w->data)->debug_level) {
@@ -265,30 +917,69 @@ static void accept_cb(struct ev_loop *loop, ev_io * w, int revents)
 				  s, sizeof s);
 			printf("server: got connection from %s\n", s);
 		}
+		fcntl(connection_watcher->fd, F_SETFL,
+		      fcntl(connection_watcher->fd, F_GETFL) | O_NONBLOCK);
 		ev_io_init(&connection_watcher->io, connection_cb,
 			   connection_watcher->fd, EV_READ);
+		ev_io_init(&connection_watcher->write_io, write_cb,
+			   connection_watcher->fd, EV_WRITE);
 		//copy pointer to struct jrpc_server
 		connection_watcher->io.data = w->data;
+		connection_watcher->write_io.data = w->data;
 		connection_watcher->buffer_size = 1500;
 		connection_watcher->buffer = malloc(1500);
 		memset(connection_watcher->buffer, 0, 1500);
 		connection_watcher->pos = 0;
+		connection_watcher->out_head = connection_watcher->out_tail = NULL;
+		connection_watcher->out_len = 0;
+		connection_watcher->closing = 0;
+		connection_watcher->jobs_head = connection_watcher->jobs_tail =
+		    NULL;
+		connection_watcher->pooled = 0;
+		connection_watcher->draining = 0;
+		connection_watcher->dead = 0;
+		connection_watcher->batch = 0;
+		memset(&connection_watcher->bbuf, 0, sizeof(struct json_buffer));
+		connection_watcher->batch_job = NULL;
+		connection_watcher->capture = NULL;
+		json_parser_init(&connection_watcher->parser);
+		json_arena_init(&connection_watcher->arena, 0);
+		memset(&connection_watcher->wbuf, 0, sizeof(struct json_buffer));
+		connection_watcher->parser.arena = &connection_watcher->arena;
+		// requests only live until they are answered, so their strings
+		// can stay in the read buffer
+		connection_watcher->parser.insitu = 1;
+		// params are only parsed once a handler looks at them
+		connection_watcher->parser.lazy = "params";
 		//copy debug_level, struct jrpc_connection has no pointer to struct jrpc_server
 		connection_watcher->debug_level =
 		    ((struct jrpc_server *)w->data)->debug_level;
+		connection_watcher->worker = worker;
 		ev_io_start(loop, &connection_watcher->io);
 	}
 }
 
-int jrpc_server_init(struct jrpc_server *server, char *addr)
+// Make the code work with both the old (ev_loop/ev_unloop)
+// and new (ev_run/ev_break) versions of libev.
+#ifdef EVUNLOOP_ALL
+#define EV_RUN ev_loop
+#define EV_BREAK ev_unloop
+#define EVBREAK_ALL EVUNLOOP_ALL
+#else
+#define EV_RUN ev_run
+#define EV_BREAK ev_break
+#endif
+
+static void stop_cb(struct ev_loop *loop, ev_async * w, int revents)
 {
-	loop = EV_DEFAULT;
-	return jrpc_server_init_with_ev_loop(server, addr, loop);
+	EV_BREAK(loop, EVBREAK_ALL);
 }
 
-int jrpc_server_init_with_ev_loop(struct jrpc_server *server,
-				  char *addr, struct ev_loop *loop)
+static int server_init(struct jrpc_server *server, char *addr,
+		       struct ev_loop *loop, int workers)
 {
+	int i;
+
 	memset(server, 0, sizeof(struct jrpc_server));
 	server->loop = loop;
 	server->addr = addr;
@@ -299,15 +990,91 @@ int jrpc_server_init_with_ev_loop(struct jrpc_server *server,
 		server->debug_level = strtol(debug_level_env, NULL, 10);
 		printf("JSONRPC-C Debug level %d\n", server->debug_level);
 	}
+
+	server->workers = calloc(workers, sizeof(struct jrpc_worker));
+	if (!server->workers) {
+		perror("calloc");
+		return -1;
+	}
+	server->worker_count = workers;
+	for (i = 0; i < workers; i++) {
+		struct jrpc_worker *worker = &server->workers[i];
+		worker->server = server;
+		worker->loop = i ? ev_loop_new(EVFLAG_AUTO) : loop;
+		if (!worker->loop) {
+			fprintf(stderr, "server: can not create event loop\n");
+			server->worker_count = i;
+			return -1;
+		}
+		worker->listen_watcher.fd = -1;
+		ev_async_init(&worker->stop_watcher, stop_cb);
+		ev_async_start(worker->loop, &worker->stop_watcher);
+		ev_async_init(&worker->done_watcher, done_cb);
+		ev_async_start(worker->loop, &worker->done_watcher);
+		pthread_mutex_init(&worker->done_lock, NULL);
+	}
+	pthread_mutex_init(&server->pool.lock, NULL);
+	pthread_cond_init(&server->pool.cond, NULL);
 	return __jrpc_server_start(server);
 }
 
+int jrpc_server_init(struct jrpc_server *server, char *addr)
+{
+	return jrpc_server_init_workers(server, addr, 1);
+}
+
+int jrpc_server_init_workers(struct jrpc_server *server, char *addr,
+			     int workers)
+{
+	if (workers <= 0)
+		workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (workers <= 0)
+		workers = 1;
+	return server_init(server, addr, EV_DEFAULT, workers);
+}
+
+int jrpc_server_init_with_ev_loop(struct jrpc_server *server,
+				  char *addr, struct ev_loop *loop)
+{
+	return server_init(server, addr, loop, 1);
+}
+
+// another socket listening on the address worker 0 is bound to,
+// the kernel balances new connections over all of them
+static int listen_again(struct sockaddr *addr, socklen_t len)
+{
+#ifdef SO_REUSEPORT
+	int fd, yes = 1;
+
+	if ((fd = socket(addr->sa_family, SOCK_STREAM, 0)) == -1)
+		return -1;
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int)) == -1
+	    || setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes,
+			  sizeof(int)) == -1
+	    || bind(fd, addr, len) == -1 || listen(fd, SOMAXCONN) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+#else
+	return -1;
+#endif
+}
+
+static void start_listener(struct jrpc_worker *worker, int fd)
+{
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	ev_io_init(&worker->listen_watcher, accept_cb, fd, EV_READ);
+	worker->listen_watcher.data = worker->server;
+	ev_io_start(worker->loop, &worker->listen_watcher);
+}
+
 static int __jrpc_server_start(struct jrpc_server *server)
 {
-	int sockfd;
+	int sockfd, fd, i;
 	struct addrinfo hints, *servinfo, *p;
-	struct sockaddr_in sockaddr;
-	unsigned int len;
+	struct sockaddr_storage sockaddr;
+	socklen_t len;
 	int yes = 1;
 	int rv;
 	char buff[128], *host, *port;
@@ -346,6 +1113,11 @@ static int __jrpc_server_start(struct jrpc_server *server)
 			perror("setsockopt");
 			exit(1);
 		}
+#ifdef SO_REUSEPORT
+		if (server->worker_count > 1)
+			setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &yes,
+				   sizeof(int));
+#endif
 
 		if (bind(sockfd, p->ai_addr, p->ai_addrlen) == -1) {
 			close(sockfd);
@@ -372,55 +1144,185 @@ static int __jrpc_server_start(struct jrpc_server *server)
 
 	freeaddrinfo(servinfo);	// all done with this structure
 
-	if (listen(sockfd, 5) == -1) {
+	if (listen(sockfd, SOMAXCONN) == -1) {
 		perror("listen");
 		exit(1);
 	}
 	if (server->debug_level)
 		printf("server: waiting for connections...\n");
 
-	ev_io_init(&server->listen_watcher, accept_cb, sockfd, EV_READ);
-	server->listen_watcher.data = server;
-	ev_io_start(server->loop, &server->listen_watcher);
+	start_listener(&server->workers[0], sockfd);
+	for (i = 1; i < server->worker_count; i++) {
+		// without SO_REUSEPORT the workers share worker 0's socket
+		if ((fd = listen_again((struct sockaddr *)&sockaddr, len)) == -1)
+			fd = sockfd;
+		start_listener(&server->workers[i], fd);
+	}
 	return 0;
 }
 
-// Make the code work with both the old (ev_loop/ev_unloop)
-// and new (ev_run/ev_break) versions of libev.
-#ifdef EVUNLOOP_ALL
-#define EV_RUN ev_loop
-#define EV_BREAK ev_unloop
-#define EVBREAK_ALL EVUNLOOP_ALL
-#else
-#define EV_RUN ev_run
-#define EV_BREAK ev_break
-#endif
-
-void jrpc_server_run(struct jrpc_server *server)
+static void *pool_run(void *arg)
 {
-	EV_RUN(server->loop, 0);
+	struct jrpc_pool *pool = arg;
+	struct json *result;
+	struct jrpc_job *job;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		while (!pool->head && !pool->stopping)
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		if ((job = pool->head) && !(pool->head = job->queue_next))
+			pool->tail = NULL;
+		pthread_mutex_unlock(&pool->lock);
+		if (!job)
+			return NULL;
+
+		job->queue_next = NULL;
+		result = job_run(job);
+		json_arena_bind(NULL);
+		job_returned(job, result);
+	}
 }
 
-int jrpc_server_stop(struct jrpc_server *server)
+int jrpc_server_set_pool(struct jrpc_server *server, int threads)
 {
-	EV_BREAK(server->loop, EVBREAK_ALL);
+	if (server->pool.started) {
+		fprintf(stderr, "server: pool already running\n");
+		return -1;
+	}
+	server->pool.size = threads > 0 ? threads : 0;
 	return 0;
 }
 
-void jrpc_server_destroy(struct jrpc_server *server)
+static void pool_start(struct jrpc_pool *pool)
 {
-	/* Don't destroy server */
-	int i;
-	for (i = 0; i < server->procedure_count; i++) {
-		jrpc_procedure_destroy(&(server->procedures[i]));
+	int err;
+
+	if (!pool->size)
+		return;
+	pool->threads = calloc(pool->size, sizeof(pthread_t));
+	if (!pool->threads) {
+		perror("calloc");
+		return;
+	}
+	pool->stopping = 0;
+	for (pool->started = 0; pool->started < pool->size; pool->started++) {
+		err = pthread_create(&pool->threads[pool->started], NULL,
+				     pool_run, pool);
+		if (err) {
+			fprintf(stderr, "server: pool: %s\n", strerror(err));
+			break;
+		}
 	}
-	free(server->procedures);
 }
 
-static void jrpc_procedure_destroy(struct jrpc_procedure *procedure)
+// the queue is run down before the threads exit
+static void pool_stop(struct jrpc_pool *pool)
 {
-	if (procedure->name) {
-		free(procedure->name);
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = 1;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+	while (pool->started)
+		pthread_join(pool->threads[--pool->started], NULL);
+	free(pool->threads);
+	pool->threads = NULL;
+}
+
+static void *worker_run(void *arg)
+{
+	struct jrpc_worker *worker = arg;
+	EV_RUN(worker->loop, 0);
+	return NULL;
+}
+
+void jrpc_server_run(struct jrpc_server *server)
+{
+	struct jrpc_worker *worker;
+	int i, err;
+
+	pool_start(&server->pool);
+	for (i = 1; i < server->worker_count; i++) {
+		worker = &server->workers[i];
+		err = pthread_create(&worker->thread, NULL, worker_run, worker);
+		if (err) {
+			fprintf(stderr, "server: worker %d: %s\n", i,
+				strerror(err));
+			continue;
+		}
+		worker->running = 1;
+	}
+	EV_RUN(server->loop, 0);
+	for (i = 1; i < server->worker_count; i++) {
+		worker = &server->workers[i];
+		if (worker->running)
+			pthread_join(worker->thread, NULL);
+		worker->running = 0;
+	}
+	pool_stop(&server->pool);
+}
+
+// safe to call from any thread, handlers included
+int jrpc_server_stop(struct jrpc_server *server)
+{
+	int i;
+	for (i = 0; i < server->worker_count; i++)
+		ev_async_send(server->workers[i].loop,
+			      &server->workers[i].stop_watcher);
+	return 0;
+}
+
+void jrpc_server_destroy(struct jrpc_server *server)
+{
+	/* Don't destroy server */
+	struct jrpc_worker *worker;
+	struct jrpc_job *job;
+	unsigned int i;
+	int fd;
+
+	for (i = 0; i < server->worker_count; i++) {
+		worker = &server->workers[i];
+		// answers nobody is left to send
+		pthread_mutex_lock(&worker->done_lock);
+		while ((job = worker->done)) {
+			worker->done = job->queue_next;
+			job_free(job);
+		}
+		pthread_mutex_unlock(&worker->done_lock);
+		ev_async_stop(worker->loop, &worker->done_watcher);
+		pthread_mutex_destroy(&worker->done_lock);
+		fd = worker->listen_watcher.fd;
+		if (fd != -1) {
+			ev_io_stop(worker->loop, &worker->listen_watcher);
+			if (!i || fd != server->workers[0].listen_watcher.fd)
+				close(fd);
+		}
+		ev_async_stop(worker->loop, &worker->stop_watcher);
+		if (i)
+			ev_loop_destroy(worker->loop);
+	}
+	free(server->workers);
+	server->workers = NULL;
+	server->worker_count = 0;
+	pthread_mutex_destroy(&server->pool.lock);
+	pthread_cond_destroy(&server->pool.cond);
+
+	for (i = 0; i < server->procedure_slots; i++) {
+		if (!server->procedures[i])
+			continue;
+		jrpc_procedure_destroy(server->procedures[i]);
+		free(server->procedures[i]);
+	}
+	free(server->procedures);
+	server->procedures = NULL;
+	server->procedure_slots = 0;
+	server->procedure_count = 0;
+}
+
+static void jrpc_procedure_destroy(struct jrpc_procedure *procedure)
+{
+	if (procedure->name) {
+		free(procedure->name);
 		procedure->name = NULL;
 	}
 	if (procedure->data) {
@@ -429,78 +1331,438 @@ static void jrpc_procedure_destroy(struct jrpc_procedure *procedure)
 	}
 }
 
+// FNV-1a, method names are short
+static unsigned int procedure_hash(const char *name)
+{
+	unsigned int hash = 2166136261u;
+	while (*name)
+		hash = (hash ^ (unsigned char)*name++) * 16777619u;
+	return hash;
+}
+
+// slot holding name, or the empty slot ending its probe sequence
+static unsigned int procedure_slot(struct jrpc_server *server,
+				   const char *name, unsigned int hash,
+				   unsigned int *probes)
+{
+	unsigned int mask = server->procedure_slots - 1;
+	unsigned int i = hash & mask;
+	unsigned int n = 1;
+	struct jrpc_procedure *procedure;
+
+	while ((procedure = server->procedures[i]) != NULL) {
+		if (procedure->hash == hash && !strcmp(procedure->name, name))
+			break;
+		i = (i + 1) & mask;
+		n++;
+	}
+	if (probes)
+		*probes = n;
+	return i;
+}
+
+static int procedure_table_grow(struct jrpc_server *server)
+{
+	struct jrpc_procedure **old = server->procedures;
+	unsigned int old_slots = server->procedure_slots;
+	unsigned int i;
+
+	server->procedure_slots = old_slots ? old_slots * 2
+	    : JRPC_PROCEDURE_SLOTS;
+	server->procedures = calloc(server->procedure_slots, sizeof(*old));
+	if (!server->procedures) {
+		perror("calloc");
+		server->procedures = old;
+		server->procedure_slots = old_slots;
+		return -1;
+	}
+	for (i = 0; i < old_slots; i++) {
+		if (old[i])
+			server->procedures[procedure_slot(server, old[i]->name,
+							  old[i]->hash, NULL)]
+			    = old[i];
+	}
+	free(old);
+	return 0;
+}
+
+static struct jrpc_procedure *procedure_lookup(struct jrpc_server *server,
+					       const char *name,
+					       struct jrpc_lookup_stats *stats)
+{
+	unsigned int i, probes;
+
+	stats->lookups++;
+	if (!server->procedure_count) {
+		stats->misses++;
+		return NULL;
+	}
+	i = procedure_slot(server, name, procedure_hash(name), &probes);
+	stats->probes += probes;
+	if (probes > stats->max_probe)
+		stats->max_probe = probes;
+	if (!server->procedures[i])
+		stats->misses++;
+	return server->procedures[i];
+}
+
+struct jrpc_procedure *jrpc_find_procedure(struct jrpc_server *server,
+					   const char *name)
+{
+	return procedure_lookup(server, name, &server->lookup_stats);
+}
+
+// workers count their own lookups, the sum is exact once they stopped
+void jrpc_server_lookup_stats(struct jrpc_server *server,
+			      struct jrpc_lookup_stats *stats)
+{
+	struct jrpc_lookup_stats *worker;
+	int i;
+
+	*stats = server->lookup_stats;
+	for (i = 0; i < server->worker_count; i++) {
+		worker = &server->workers[i].lookup_stats;
+		stats->lookups += worker->lookups;
+		stats->misses += worker->misses;
+		stats->probes += worker->probes;
+		if (worker->max_probe > stats->max_probe)
+			stats->max_probe = worker->max_probe;
+	}
+}
+
 int jrpc_register_procedure(struct jrpc_server *server,
 			    jrpc_function function_pointer, char *name,
 			    void *data)
 {
-	struct jrpc_procedure *ptr;
-	int i = server->procedure_count++;
+	return jrpc_register_procedure_flags(server, function_pointer, name,
+					     data, 0);
+}
 
-	if (!server->procedures)
-		server->procedures = malloc(sizeof(struct jrpc_procedure));
-	else {
-		ptr =
-		    realloc(server->procedures,
-			    sizeof(struct jrpc_procedure) *
-			    server->procedure_count);
-		if (!ptr)
-			return -1;
-		server->procedures = ptr;
+int jrpc_register_procedure_flags(struct jrpc_server *server,
+				  jrpc_function function_pointer, char *name,
+				  void *data, int flags)
+{
+	return jrpc_register_stream_procedure(server, NULL, function_pointer,
+					      name, data, flags);
+}
 
+int jrpc_register_stream_procedure(struct jrpc_server *server,
+				   const struct json_events *events,
+				   jrpc_function function_pointer, char *name,
+				   void *data, int flags)
+{
+	struct jrpc_procedure *procedure;
+	unsigned int hash = procedure_hash(name);
+	unsigned int i;
+
+	if ((server->procedure_count + 1) * 2 > server->procedure_slots
+	    && procedure_table_grow(server) < 0)
+		return -1;
+
+	i = procedure_slot(server, name, hash, NULL);
+	procedure = server->procedures[i];
+	if (procedure) {
+		// registering a name again replaces it, the handle stays valid
+		if (procedure->data && procedure->data != data)
+			free(procedure->data);
+		procedure->function = function_pointer;
+		procedure->events = events;
+		procedure->data = data;
+		procedure->flags = flags;
+		return 0;
 	}
-	if ((server->procedures[i].name = strdup(name)) == NULL)
+
+	if ((procedure = malloc(sizeof(*procedure))) == NULL)
+		return -1;
+	if ((procedure->name = strdup(name)) == NULL) {
+		free(procedure);
 		return -1;
-	server->procedures[i].function = function_pointer;
-	server->procedures[i].data = data;
+	}
+	procedure->function = function_pointer;
+	procedure->events = events;
+	procedure->data = data;
+	procedure->hash = hash;
+	procedure->flags = flags;
+	server->procedures[i] = procedure;
+	server->procedure_count++;
 	return 0;
 }
 
 int jrpc_deregister_procedure(struct jrpc_server *server, char *name)
 {
-	/* Search the procedure to deregister */
-	int i;
-	struct jrpc_procedure *ptr;
-	int found = 0;
+	struct jrpc_procedure *procedure;
+	unsigned int mask = server->procedure_slots - 1;
+	unsigned int i, j, home;
 
-	if (!server->procedures) {
+	if (!server->procedure_count) {
 		fprintf(stderr, "server : procedure '%s' not found\n", name);
 		return -1;
 	}
 
-	for (i = 0; i < server->procedure_count; i++) {
-		if (found)
-			server->procedures[i - 1] = server->procedures[i];
-		else if (!strcmp(name, server->procedures[i].name)) {
-			found = 1;
-			jrpc_procedure_destroy(&(server->procedures[i]));
+	i = procedure_slot(server, name, procedure_hash(name), NULL);
+	procedure = server->procedures[i];
+	if (!procedure)
+		return 0;
+
+	jrpc_procedure_destroy(procedure);
+	free(procedure);
+	server->procedures[i] = NULL;
+	server->procedure_count--;
+
+	/*
+	 * Pull the rest of the probe run back over the hole, so lookups
+	 * never need tombstones: an entry moves unless its home slot lies
+	 * cyclically within (i, j].
+	 */
+	for (j = (i + 1) & mask; (procedure = server->procedures[j]) != NULL;
+	     j = (j + 1) & mask) {
+		home = procedure->hash & mask;
+		if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+			continue;
+		server->procedures[i] = procedure;
+		server->procedures[j] = NULL;
+		i = j;
+	}
+	return 0;
+}
+
+/* jsonrpc client */
+
+#define JRPC_CALL_SLOTS 64
+
+// the slot a call waits in; a new id landing on one still waiting makes
+// the table grow until it doesn't
+static struct jrpc_call *call_slot(struct jrpc_client *client, int id)
+{
+	return &client->calls[(unsigned int)id & (client->call_slots - 1)];
+}
+
+static int call_table_grow(struct jrpc_client *client)
+{
+	struct jrpc_call *calls = client->calls, *call;
+	unsigned int slots = client->call_slots, i;
+
+	client->call_slots = slots ? slots * 2 : JRPC_CALL_SLOTS;
+	client->calls = calloc(client->call_slots, sizeof(struct jrpc_call));
+	if (client->calls == NULL) {
+		perror("Memory error");
+		client->calls = calls;
+		client->call_slots = slots;
+		return -ENOMEM;
+	}
+	for (i = 0; i < slots; i++) {
+		if (!calls[i].used)
+			continue;
+		if ((call = call_slot(client, calls[i].id))->used) {
+			free(client->calls);
+			client->calls = calls;
+			client->call_slots = slots * 2;
+			return call_table_grow(client);
 		}
+		*call = calls[i];
 	}
+	free(calls);
+	return 0;
+}
 
-	if (!found)
-		return 0;
+static int call_insert(struct jrpc_client *client, int id,
+		       jrpc_callback callback, void *data)
+{
+	struct jrpc_call *call;
+	int ret;
+
+	while (!client->calls || (call = call_slot(client, id))->used)
+		if ((ret = call_table_grow(client)) < 0)
+			return ret;
+	call->callback = callback;
+	call->data = data;
+	call->id = id;
+	call->used = 1;
+	client->pending++;
+	return 0;
+}
 
-	server->procedure_count--;
+// hand a response to the call it answers, unexpected ones are dropped
+static void client_dispatch(struct jrpc_client *client, struct json *root)
+{
+	struct jrpc_call *call = NULL;
+	struct json *id = NULL;
+	jrpc_callback callback;
+	void *data;
+	int n;
+
+	if (root->type == JSON_T_OBJECT)
+		id = json_get_object_item_case_sensitive(root, "id");
+	if (id && (id->type == JSON_T_NUMBER || id->type == JSON_T_STRING)) {
+		n = id->type == JSON_T_STRING ? atoi(id->valuestring)
+		    : id->valueint;
+		if (client->calls && (call = call_slot(client, n))->used
+		    && call->id != n)
+			call = NULL;
+	}
+	if (call == NULL || !call->used) {
+		if (client->debug_level)
+			printf("Unexpected response dropped.\n");
+		json_delete(root);
+		return;
+	}
+	callback = call->callback;
+	data = call->data;
+	call->used = 0;
+	client->pending--;
+	callback(client, root, data);
+	json_delete(root);
+}
 
-	if (!server->procedure_count) {
-		server->procedures = NULL;
+// the connection is unusable: the calls waiting on it fail
+static void client_fail(struct jrpc_client *client, int error)
+{
+	struct jrpc_call *call;
+	unsigned int i;
+
+	if (client->loop) {
+		ev_io_stop(client->loop, &client->conn.io);
+		ev_io_stop(client->loop, &client->conn.write_io);
+	}
+	if (!client->error) {
+		client->error = error;
+		if (client->failed)
+			client->failed(client);
 	}
+	for (i = 0; i < client->call_slots && client->pending; i++) {
+		call = &client->calls[i];
+		if (!call->used)
+			continue;
+		call->used = 0;
+		client->pending--;
+		call->callback(client, NULL, call->data);
+	}
+}
 
-	ptr = realloc(server->procedures, sizeof(struct jrpc_procedure)
-		      * server->procedure_count);
-	if (!ptr) {
-		perror("realloc");
-		return -1;
+// read what the socket has and dispatch the complete responses in it.
+// Returns 0, 1 if there was nothing to read, <0 on error
+static int client_read(struct jrpc_client *client)
+{
+	struct jrpc_connection *conn = &client->conn;
+	char *new_buffer;
+	ssize_t n;
+	int ret;
+
+	if (conn->pos == (conn->buffer_size - 1)) {
+		conn->buffer_size *= 2;
+		new_buffer = realloc(conn->buffer, conn->buffer_size);
+		if (new_buffer == NULL) {
+			perror("Memory error");
+			return -ENOMEM;
+		}
+		conn->buffer = new_buffer;
+	}
+	// can not fill the entire buffer, string must be NULL terminated
+	n = read(conn->fd, conn->buffer + conn->pos,
+		 conn->buffer_size - conn->pos - 1);
+	if (n == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return 1;
+		perror("read");
+		return -EIO;
+	}
+	if (!n) {
+		if (client->debug_level)
+			printf("Server closed connection.\n");
+		return -EIO;
+	}
+	conn->pos += n;
+	conn->buffer[conn->pos] = '\0';
+
+	while ((ret = json_parser_feed(&conn->parser, conn->buffer,
+				       conn->pos)) == JSON_PARSE_DONE) {
+		if (client->debug_level > 1) {
+			char *str_result = json_sprint(conn->parser.root);
+			printf("Valid JSON Received:\n%s\n", str_result);
+			json_free(str_result);
+		}
+		client_dispatch(client, json_parser_result(&conn->parser));
+	}
+	if (ret == JSON_PARSE_ERROR) {
+		if (client->debug_level) {
+			printf("INVALID JSON Received:\n---\n%s\n---\n",
+			       conn->buffer);
+		}
+		send_error(conn, JRPC_PARSE_ERROR,
+			   strdup("Parse error. Invalid JSON"
+				  " was received by the client."),
+			   NULL);
+		__flush_output(conn, MSG_DONTWAIT);
+		return -EINVAL;
 	}
-	server->procedures = ptr;
+	//discard processed responses
+	conn->pos = json_parser_compact(&conn->parser, conn->buffer, conn->pos);
+	conn->buffer[conn->pos] = '\0';
 	return 0;
 }
 
-/* jsonrpc client */
+// write what the socket takes now, the loop writes the rest
+static int client_flush(struct jrpc_client *client)
+{
+	int ret = __flush_output(&client->conn, MSG_DONTWAIT);
+
+	if (ret < 0)
+		client_fail(client, ret);
+	else if (ret && client->loop)
+		ev_io_start(client->loop, &client->conn.write_io);
+	return ret < 0 ? ret : 0;
+}
+
+// wait for the socket, when a blocking call has to on a started client
+static void client_wait(struct jrpc_client *client, short events)
+{
+	struct pollfd pfd = { client->conn.fd, events, 0 };
+
+	while (poll(&pfd, 1, -1) == -1 && errno == EINTR)
+		;
+}
+
+static void client_read_cb(struct ev_loop *loop, ev_io * w, int revents)
+{
+	struct jrpc_client *client = (struct jrpc_client *)((char *)w -
+			offsetof(struct jrpc_client, conn.io));
+	int ret = 0;
+
+	while (!client->error && (ret = client_read(client)) == 0)
+		;
+	if (ret < 0)
+		client_fail(client, ret);
+}
+
+static void client_write_cb(struct ev_loop *loop, ev_io * w, int revents)
+{
+	struct jrpc_client *client = (struct jrpc_client *)((char *)w -
+			offsetof(struct jrpc_client, conn.write_io));
+	int ret = __flush_output(&client->conn, MSG_DONTWAIT);
+
+	if (ret < 0)
+		client_fail(client, ret);
+	else if (!ret)
+		ev_io_stop(loop, w);
+}
+
 void jrpc_client_close(struct jrpc_client *client)
 {
-	close(client->conn.fd);
+	// notifications the socket didn't take yet
+	if (client->conn.out_len)
+		flush_output(&client->conn);
+	client_fail(client, -ECANCELED);
+	if (client->conn.fd >= 0)
+		close(client->conn.fd);
+	json_parser_destroy(&client->conn.parser);
+	free_output(&client->conn);
+	json_buffer_free(&client->conn.wbuf);
 	free(client->conn.buffer);
 	client->conn.buffer = NULL;
+	free(client->calls);
+	client->calls = NULL;
+	client->call_slots = 0;
+	client->loop = NULL;
 }
 
 static int _connect(int domain, int type, int protocol,
@@ -521,11 +1783,8 @@ static int _connect(int domain, int type, int protocol,
 	return -1;
 }
 
-int jrpc_client_init(struct jrpc_client *client, char *addr)
+static void client_setup(struct jrpc_client *client, char *addr)
 {
-	struct addrinfo hints, *servinfo, *p;
-	int rv;
-	char buff[128], *host, *port;
 	char *debug_level_env;
 
 	memset(client, 0, sizeof(*client));
@@ -538,18 +1797,29 @@ int jrpc_client_init(struct jrpc_client *client, char *addr)
 	}
 
 	client->addr = addr;
+	client->conn.fd = -1;
 	client->conn.buffer_size = 1500;
 	client->conn.buffer = malloc(1500);
 	memset(client->conn.buffer, 0, 1500);
 	client->conn.pos = 0;
+	json_parser_init(&client->conn.parser);
 	client->conn.debug_level = client->debug_level;
+}
+
+// host:port to the addresses to try, NULL on error
+static struct addrinfo *client_resolve(const char *addr)
+{
+	struct addrinfo hints, *servinfo;
+	int rv;
+	char buff[128], *host, *port;
 
-	strncpy(buff, client->addr, sizeof(buff) - 1);
+	strncpy(buff, addr, sizeof(buff) - 1);
+	buff[sizeof(buff) - 1] = '\0';
 	host = buff;
 	port = strchr(host, ':');
 	if (port == NULL) {
-		fprintf(stderr, "err server connect address %s\n", client->addr);
-		return 1;
+		fprintf(stderr, "err server connect address %s\n", addr);
+		return NULL;
 	}
 	*port++ = '\0';
 
@@ -560,8 +1830,18 @@ int jrpc_client_init(struct jrpc_client *client, char *addr)
 	if ((rv = getaddrinfo(host, port, &hints, &servinfo)) != 0) {
 		fprintf(stderr, "err:%s host:%s port:%s\n",
 			gai_strerror(rv), host, port);
-		return 1;
+		return NULL;
 	}
+	return servinfo;
+}
+
+int jrpc_client_init(struct jrpc_client *client, char *addr)
+{
+	struct addrinfo *servinfo, *p;
+
+	client_setup(client, addr);
+	if ((servinfo = client_resolve(addr)) == NULL)
+		return 1;
 
 	for (p = servinfo; p != NULL; p = p->ai_next) {
 		if ((client->conn.fd = _connect(p->ai_family, p->ai_socktype, p->ai_protocol,
@@ -572,118 +1852,469 @@ int jrpc_client_init(struct jrpc_client *client, char *addr)
 		break;
 	}
 
+	freeaddrinfo(servinfo);	// all done with this structure
+
 	if (p == NULL) {
 		fprintf(stderr, "client: failed to connect\n");
 		return 2;
 	}
 
-	freeaddrinfo(servinfo);	// all done with this structure
+	return 0;
+}
 
+int jrpc_client_start(struct jrpc_client *client, struct ev_loop *loop)
+{
+	struct jrpc_connection *conn = &client->conn;
+
+	if (client->loop)
+		return -EBUSY;
+	fcntl(conn->fd, F_SETFL, fcntl(conn->fd, F_GETFL) | O_NONBLOCK);
+	ev_io_init(&conn->io, client_read_cb, conn->fd, EV_READ);
+	ev_io_init(&conn->write_io, client_write_cb, conn->fd, EV_WRITE);
+	client->loop = loop;
+	ev_io_start(loop, &conn->io);
+	if (conn->out_len)
+		ev_io_start(loop, &conn->write_io);
 	return 0;
 }
 
-int jrpc_client_call(struct jrpc_client *client, const char *method,
-		struct json *params, struct json **response)
+// fire and forget: no id, so the server doesn't answer. What the socket
+// doesn't take right away goes out ahead of the next call, or from the
+// loop on a started client
+int jrpc_client_notify(struct jrpc_client *client, const char *method,
+		       struct json *params)
 {
-	int fd, max_read_size;
-	size_t bytes_read = 0;
-	char *str_result, *new_buffer, *str_request, *end_ptr = NULL;
-	struct jrpc_connection *conn;
-	struct json *root, *request;
+	struct json *request;
+	int ret;
 
+	if (client->error) {
+		json_delete(params);
+		return client->error;
+	}
 	request = json_create_object();
 	json_add_string_to_object(request, "method", method);
 	json_add_item_to_object(request, "params", params);
-	json_add_number_to_object(request, "id", client->id);
-	str_request = json_sprint(request);
-
-	send_request(&client->conn, str_request);
-	json_free(str_request);
+	ret = queue_message(&client->conn, request, "Notification");
 	json_delete(request);
+	if (ret)
+		return ret;
+	return client_flush(client);
+}
 
+// the start of a request to conn->wbuf: {"method":"name"
+static int render_method(struct json_buffer *b, const char *method)
+{
+	struct json name;
+
+	memset(&name, 0, sizeof(name));
+	name.type = JSON_T_STRING;
+	name.valuestring = (char *)method;
+	b->len = 0;
+	if (json_buffer_append(b, "{\"method\":", 10)
+	    || json_print_append(b, &name, 0))
+		return -ENOMEM;
+	return 0;
+}
 
+// finish the request started in conn->wbuf with params and the id, queue
+// it and send what the socket takes. Nothing is allocated once the buffers
+// and the call table are big enough
+static int client_send(struct jrpc_client *client, struct json *params,
+		       jrpc_callback callback, void *data)
+{
+	struct jrpc_connection *conn = &client->conn;
+	struct json_buffer *b = &conn->wbuf;
+	char id[32];
+	int ret, n;
+
+	if (client->error)
+		return client->error;
+	n = sprintf(id, ",\"id\":%d}", client->id);
+	if ((params && (json_buffer_append(b, ",\"params\":", 10)
+			|| json_print_append(b, params, 0)))
+	    || json_buffer_append(b, id, n))
+		return -ENOMEM;
+	if ((ret = call_insert(client, client->id, callback, data)) < 0)
+		return ret;
+	if (conn->debug_level > 1)
+		printf("JSON Request:\n%s\n", b->data);
+	if ((ret = send_output(conn, b->data, b->len))) {
+		call_slot(client, client->id)->used = 0;
+		client->pending--;
+		return ret;
+	}
+	client->id++;
+	// a failure from here on reaches the callback
+	client_flush(client);
+	return 0;
+}
 
-	// read
-	conn = &client->conn;
-	fd = conn->fd;
+int jrpc_client_call_async(struct jrpc_client *client, const char *method,
+			   struct json *params, jrpc_callback callback,
+			   void *data)
+{
+	int ret = render_method(&client->conn.wbuf, method);
 
-	for (;;){
-		if (conn->pos == (conn->buffer_size - 1)) {
-			conn->buffer_size *= 2;
-			new_buffer = realloc(conn->buffer, conn->buffer_size);
-			if (new_buffer == NULL) {
-				perror("Memory error");
-				return -ENOMEM;
-			}
-			conn->buffer = new_buffer;
-			memset(conn->buffer + conn->pos, 0,
-			       conn->buffer_size - conn->pos);
-		}
-		// can not fill the entire buffer, string must be NULL terminated
-		max_read_size = conn->buffer_size - conn->pos - 1;
-		if ((bytes_read = read(fd, conn->buffer + conn->pos, max_read_size))
-		    == -1) {
-			perror("read");
-			return -EIO;
+	if (!ret)
+		ret = client_send(client, params, callback, data);
+	json_delete(params);
+	return ret;
+}
+
+int jrpc_client_prepare(struct jrpc_prepared_call *call, const char *method)
+{
+	struct json_buffer b = { NULL, 0, 0, 0 };
+
+	memset(call, 0, sizeof(*call));
+	if (render_method(&b, method)) {
+		json_buffer_free(&b);
+		return -ENOMEM;
+	}
+	call->prefix = b.data;
+	call->prefix_len = b.len;
+	return 0;
+}
+
+void jrpc_prepared_call_free(struct jrpc_prepared_call *call)
+{
+	json_free(call->prefix);
+	call->prefix = NULL;
+	call->prefix_len = 0;
+}
+
+int jrpc_client_call_prepared(struct jrpc_client *client,
+			      const struct jrpc_prepared_call *call,
+			      struct json *params, jrpc_callback callback,
+			      void *data)
+{
+	struct json_buffer *b = &client->conn.wbuf;
+
+	b->len = 0;
+	if (json_buffer_append(b, call->prefix, call->prefix_len))
+		return -ENOMEM;
+	return client_send(client, params, callback, data);
+}
+
+struct call_wait {
+	int done;
+	int ret;
+	struct json *result;
+};
+
+static void call_wait_cb(struct jrpc_client *client, struct json *response,
+			 void *data)
+{
+	struct call_wait *w = data;
+	char *str;
+
+	w->done = 1;
+	if (response == NULL) {
+		w->ret = client->error;
+		return;
+	}
+	if ((w->result = json_detach_item_from_object(response, "result")))
+		return;
+	str = json_sprint(response);
+	printf("INVALID JSON Received:\n---\n%s\n---\n", str);
+	json_free(str);
+	w->ret = -EINVAL;
+}
+
+// the blocking call: the async one, then read until it is answered,
+// dispatching whatever else comes in meanwhile
+int jrpc_client_call(struct jrpc_client *client, const char *method,
+		struct json *params, struct json **response)
+{
+	struct jrpc_connection *conn = &client->conn;
+	struct call_wait w = { 0, 0, NULL };
+	int ret;
+
+	if ((ret = jrpc_client_call_async(client, method, params,
+					  call_wait_cb, &w)) < 0)
+		return ret;
+	while (!w.done && conn->out_len) {
+		if ((ret = __flush_output(conn, 0)) < 0) {
+			client_fail(client, ret);
+			break;
 		}
-		if (!bytes_read) {
-			// client closed the sending half of the connection
-			if (client->debug_level)
-				printf("Client closed connection.\n");
-			return -EIO;
+		if (ret)
+			client_wait(client, POLLOUT);
+	}
+	while (!w.done) {
+		if ((ret = client_read(client)) < 0)
+			client_fail(client, ret);
+		else if (ret)
+			client_wait(client, POLLIN);
+	}
+	if (w.ret)
+		return w.ret;
+	*response = w.result;
+	return 0;
+}
+
+/* jsonrpc client pool */
+
+#define POOL_DOWN		0
+#define POOL_CONNECTING		1
+#define POOL_UP			2
+
+static struct jrpc_pooled_client *pooled_client(struct jrpc_client *client)
+{
+	return (struct jrpc_pooled_client *)((char *)client -
+			offsetof(struct jrpc_pooled_client, client));
+}
+
+static unsigned int pool_random(struct jrpc_client_pool *pool)
+{
+	pool->seed ^= pool->seed << 13;
+	pool->seed ^= pool->seed >> 17;
+	pool->seed ^= pool->seed << 5;
+	return pool->seed;
+}
+
+// a pooled connection failed: count it against its endpoint, which is
+// ejected after max_failures in a row, and make it again later
+static void pool_client_failed(struct jrpc_client *client)
+{
+	struct jrpc_pooled_client *pc = pooled_client(client);
+	struct jrpc_client_pool *pool = pc->pool;
+	struct jrpc_client_endpoint *endpoint = pc->endpoint;
+	ev_tstamp delay = pool->retry;
+	int n;
+
+	// one that answered calls starts the count anew
+	if (client->id - pc->first_id > client->pending)
+		endpoint->failures = 0;
+	if ((n = ++endpoint->failures - pool->max_failures) >= 0) {
+		while (n-- >= 0 && delay < JRPC_CLIENT_POOL_RETRY_MAX)
+			delay *= 2;
+		if (delay > JRPC_CLIENT_POOL_RETRY_MAX)
+			delay = JRPC_CLIENT_POOL_RETRY_MAX;
+		endpoint->ejected_until = ev_now(pool->loop) + delay;
+		if (client->debug_level)
+			printf("Endpoint %s ejected for %gs.\n",
+			       endpoint->addr, delay);
+	}
+	pc->retry_at = ev_now(pool->loop) + delay;
+	pc->state = POOL_DOWN;
+	if (client->conn.fd >= 0)
+		close(client->conn.fd);
+	client->conn.fd = -1;
+	free_output(&client->conn);
+	if (!ev_is_active(&pool->retry_timer)) {
+		ev_timer_set(&pool->retry_timer, pool->retry, pool->retry);
+		ev_timer_start(pool->loop, &pool->retry_timer);
+	}
+}
+
+static void pool_connected_cb(struct ev_loop *loop, ev_io * w, int revents)
+{
+	struct jrpc_client *client = (struct jrpc_client *)((char *)w -
+			offsetof(struct jrpc_client, conn.write_io));
+	socklen_t len = sizeof(int);
+	int err = 0;
+
+	if (getsockopt(w->fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1)
+		err = errno;
+	if (err) {
+		if (client->debug_level)
+			printf("Connecting to %s: %s\n", client->addr,
+			       strerror(err));
+		client_fail(client, -err);
+		return;
+	}
+	// back in, though its failures only start anew once it answers
+	pooled_client(client)->state = POOL_UP;
+	pooled_client(client)->endpoint->ejected_until = 0;
+	ev_io_start(loop, &client->conn.io);
+	// from now on it writes the calls, starting with those made meanwhile
+	ev_set_cb(w, client_write_cb);
+	client_write_cb(loop, w, revents);
+}
+
+// start making the connection again, without waiting for it
+static void pool_connect(struct jrpc_client_pool *pool,
+			 struct jrpc_pooled_client *pc)
+{
+	struct jrpc_client *client = &pc->client;
+	struct jrpc_connection *conn = &client->conn;
+	struct addrinfo *p;
+	int fd = -1, err = ENOENT;
+
+	for (p = pc->endpoint->info; p != NULL; p = p->ai_next) {
+		if ((fd = socket(p->ai_family, p->ai_socktype | SOCK_NONBLOCK,
+				 p->ai_protocol)) < 0) {
+			err = errno;
+			continue;
 		}
+		if (connect(fd, p->ai_addr, p->ai_addrlen) == 0
+		    || errno == EINPROGRESS)
+			break;
+		err = errno;
+		close(fd);
+		fd = -1;
+	}
 
+	// nothing of the last connection is carried over
+	conn->pos = 0;
+	json_parser_destroy(&conn->parser);
+	json_parser_init(&conn->parser);
+	client->error = 0;
+	pc->first_id = client->id;
+	conn->fd = fd;
+	if (fd < 0) {
+		client_fail(client, -err);
+		return;
+	}
+	pc->state = POOL_CONNECTING;
+	ev_io_init(&conn->io, client_read_cb, fd, EV_READ);
+	ev_io_init(&conn->write_io, pool_connected_cb, fd, EV_WRITE);
+	ev_io_start(pool->loop, &conn->write_io);
+}
 
-		conn->pos += bytes_read;
+static void pool_retry_cb(struct ev_loop *loop, ev_timer * w, int revents)
+{
+	struct jrpc_client_pool *pool = (struct jrpc_client_pool *)((char *)w -
+			offsetof(struct jrpc_client_pool, retry_timer));
+	ev_tstamp now = ev_now(loop);
+	int i;
 
-		if ((root = json_parse_stream(conn->buffer, &end_ptr)) != NULL) {
-			if (client->debug_level > 1) {
-				str_result = json_sprint(root);
-				printf("Valid JSON Received:\n%s\n", str_result);
-				json_free(str_result);
-			}
+	for (i = 0; i < pool->client_count; i++)
+		if (pool->clients[i].state == POOL_DOWN
+		    && pool->clients[i].retry_at <= now)
+			pool_connect(pool, &pool->clients[i]);
+	for (i = 0; i < pool->client_count; i++)
+		if (pool->clients[i].state == POOL_DOWN)
+			return;
+	ev_timer_stop(loop, w);
+}
 
-			if (root->type == JSON_T_OBJECT) {
-				struct json *id = json_get_object_item(root, "id");
-
-				if (id->type == JSON_T_STRING){
-					if (client->id != atoi(id->string))
-						goto out;
-				}else if (id->type == JSON_T_NUMBER){
-					if (client->id != id->valueint)
-						goto out;
-				}
-				client->id++;
-				//shift processed request, discarding it
-				memmove(conn->buffer, end_ptr, strlen(end_ptr) + 2);
-				conn->pos = strlen(end_ptr);
-				memset(conn->buffer + conn->pos, 0,
-				       conn->buffer_size - conn->pos - 1);
-
-				*response = json_detach_item_from_object(root, "result");
-				if (*response == NULL)
-					goto out;
-
-				json_delete(root);
-				return 0;
-			}
-out:
-			printf("INVALID JSON Received:\n---\n%s\n---\n",
-			       conn->buffer);
-			json_delete(root);
-			return -EINVAL;
-		} else if (end_ptr != (conn->buffer + conn->pos)) {
-			// did we parse the all buffer? If so, just wait for more.
-			// else there was an error before the buffer's end
-			if (client->debug_level) {
-				printf("INVALID JSON Received:\n---\n%s\n---\n",
-				       conn->buffer);
-			}
-			send_error(conn, JRPC_PARSE_ERROR,
-				   strdup("Parse error. Invalid JSON"
-					  " was received by the client."),
-				   NULL);
+// calls wait for a connection being made only on an endpoint not failing
+static int pool_usable(struct jrpc_pooled_client *pc, ev_tstamp now)
+{
+	if (pc->state == POOL_DOWN || pc->endpoint->ejected_until > now)
+		return 0;
+	return pc->state == POOL_UP || !pc->endpoint->failures;
+}
+
+static struct jrpc_pooled_client *pool_pick(struct jrpc_client_pool *pool)
+{
+	struct jrpc_pooled_client *a, *b, *best = NULL;
+	ev_tstamp now = ev_now(pool->loop);
+	int i, n = pool->client_count;
+
+	if (pool->policy == JRPC_CLIENT_POOL_P2C && n > 1) {
+		i = pool_random(pool) % n;
+		a = &pool->clients[i];
+		b = &pool->clients[(i + 1 + pool_random(pool) % (n - 1)) % n];
+		if (!pool_usable(a, now)
+		    || (pool_usable(b, now)
+			&& b->client.pending < a->client.pending))
+			a = b;
+		if (pool_usable(a, now))
+			return a;
+	}
+	// the least busy, ties going round robin
+	pool->next++;
+	for (i = 0; i < n; i++) {
+		a = &pool->clients[(pool->next + i) % n];
+		if (pool_usable(a, now)
+		    && (!best || a->client.pending < best->client.pending))
+			best = a;
+	}
+	return best;
+}
+
+int jrpc_client_pool_init(struct jrpc_client_pool *pool,
+			  struct ev_loop *loop, char **addrs, int count,
+			  int per_endpoint, int policy)
+{
+	struct jrpc_pooled_client *pc;
+	int i;
+
+	memset(pool, 0, sizeof(*pool));
+	if (count <= 0 || per_endpoint <= 0)
+		return -EINVAL;
+	pool->loop = loop;
+	pool->policy = policy;
+	pool->max_failures = JRPC_CLIENT_POOL_MAX_FAILURES;
+	pool->retry = JRPC_CLIENT_POOL_RETRY;
+	pool->seed = ((unsigned int)(ev_time() * 1e6) ^ getpid()) | 1;
+	ev_timer_init(&pool->retry_timer, pool_retry_cb, pool->retry,
+		      pool->retry);
+
+	pool->endpoints = calloc(count, sizeof(struct jrpc_client_endpoint));
+	pool->clients = calloc(count * per_endpoint,
+			       sizeof(struct jrpc_pooled_client));
+	if (pool->endpoints == NULL || pool->clients == NULL) {
+		perror("Memory error");
+		jrpc_client_pool_close(pool);
+		return -ENOMEM;
+	}
+	for (i = 0; i < count; i++) {
+		pool->endpoints[i].addr = addrs[i];
+		pool->endpoint_count++;
+		if ((pool->endpoints[i].info = client_resolve(addrs[i])) == NULL) {
+			jrpc_client_pool_close(pool);
 			return -EINVAL;
 		}
 	}
+	for (i = 0; i < count * per_endpoint; i++) {
+		pc = &pool->clients[i];
+		client_setup(&pc->client, addrs[i / per_endpoint]);
+		pc->client.loop = loop;
+		pc->client.failed = pool_client_failed;
+		pc->pool = pool;
+		pc->endpoint = &pool->endpoints[i / per_endpoint];
+		pool->client_count++;
+		pool_connect(pool, pc);
+	}
+	return 0;
+}
+
+int jrpc_client_pool_call_async(struct jrpc_client_pool *pool,
+				const char *method, struct json *params,
+				jrpc_callback callback, void *data)
+{
+	struct jrpc_pooled_client *pc = pool_pick(pool);
+
+	if (pc == NULL) {
+		json_delete(params);
+		return -ENOTCONN;
+	}
+	return jrpc_client_call_async(&pc->client, method, params, callback,
+				      data);
+}
+
+int jrpc_client_pool_call_prepared(struct jrpc_client_pool *pool,
+				   const struct jrpc_prepared_call *call,
+				   struct json *params,
+				   jrpc_callback callback, void *data)
+{
+	struct jrpc_pooled_client *pc = pool_pick(pool);
+
+	if (pc == NULL)
+		return -ENOTCONN;
+	return jrpc_client_call_prepared(&pc->client, call, params, callback,
+					 data);
+}
+
+void jrpc_client_pool_close(struct jrpc_client_pool *pool)
+{
+	int i;
+
+	if (pool->loop)
+		ev_timer_stop(pool->loop, &pool->retry_timer);
+	for (i = 0; i < pool->client_count; i++) {
+		pool->clients[i].client.failed = NULL;
+		jrpc_client_close(&pool->clients[i].client);
+	}
+	for (i = 0; i < pool->endpoint_count; i++)
+		if (pool->endpoints[i].info)
+			freeaddrinfo(pool->endpoints[i].info);
+	free(pool->clients);
+	free(pool->endpoints);
+	pool->clients = NULL;
+	pool->endpoints = NULL;
+	pool->client_count = pool->endpoint_count = 0;
 }
@@ -13,6 +13,7 @@
 
 #include "json.h"
 #include <ev.h>
+#include <pthread.h>
 
 /*
  *
@@ -34,61 +35,357 @@
 #define JRPC_INVALID_PARAMS -32603
 #define JRPC_INTERNAL_ERROR -32693
 
+struct jrpc_job;
+
 struct jrpc_context{
 	void *data;
 	int error_code;
 	char *error_message;
+	/* request scoped, bind it to build the result without mallocs */
+	struct json_arena *arena;
+	/* streaming procedures: what their events gathered, starts NULL */
+	void *state;
+	/* async procedures: the call's completion token */
+	struct jrpc_job *token;
 };
 
 typedef struct json *(*jrpc_function) (struct jrpc_context * context, struct json * params,
 				 struct json * id);
 
+/*
+ * Procedures live in an open addressed table keyed by the hash of their
+ * name. Each one is allocated on its own, so the pointer returned by
+ * jrpc_find_procedure() stays valid until it is deregistered.
+ */
+#define JRPC_PROCEDURE_SLOTS 16
+
+/*
+ * Procedures flagged JRPC_PROCEDURE_POOL may block: they run on the
+ * server's handler pool (see jrpc_server_set_pool()) instead of the event
+ * loop. Such a handler gets ctx->arena to itself and may bind it from its
+ * thread. Without a pool they run inline like any other.
+ */
+#define JRPC_PROCEDURE_POOL 1
+
+/*
+ * The server leaves params unparsed until a procedure is about to run.
+ * Procedures flagged JRPC_PROCEDURE_LAZY get them that way (JSON_F_LAZY):
+ * json_get_* parses them on first use, and json_get_raw() or printing them
+ * passes the text on as it came in (json_tape_parse() reads it without
+ * building items).  Such a handler must not walk params->child directly
+ * before expanding them.
+ */
+#define JRPC_PROCEDURE_LAZY 2
+
+/*
+ * Procedures flagged JRPC_PROCEDURE_ASYNC may answer later: returning NULL
+ * without setting ctx->error_code leaves the call pending, and it is
+ * answered by passing ctx->token to jrpc_complete() or jrpc_fail(), once,
+ * from the loop or any other thread.  Until then the token keeps params,
+ * id and ctx->arena.  Answers go out in the order the requests came in,
+ * however the calls complete.  Completing a call whose connection was
+ * closed in the meantime only releases it; the connection stays allocated
+ * until its last pending call is completed, so every one must be.
+ */
+#define JRPC_PROCEDURE_ASYNC 4
+
 struct jrpc_procedure {
 	char *name;
 	jrpc_function function;
+	const struct json_events *events;	/* streaming procedures */
 	void *data;
+	unsigned int hash;
+	int flags;
 };
 
-struct jrpc_server {
-	char *addr;
+struct jrpc_lookup_stats {
+	unsigned long lookups;
+	unsigned long misses;
+	unsigned long probes;	/* slots visited by all lookups */
+	unsigned int max_probe;	/* longest single probe sequence */
+};
+
+/*
+ * A server runs one or more workers, each with its own event loop and
+ * listening socket (SO_REUSEPORT lets the kernel spread connections over
+ * them). Worker 0 runs on the thread calling jrpc_server_run(), the others
+ * on threads of their own. The procedure table is shared and only read
+ * while the workers run: register and deregister procedures before
+ * jrpc_server_run() or after it returns.
+ */
+struct jrpc_connection;
+
+/*
+ * A request handed to the pool, or a response held back until the pooled
+ * requests received before it on the same connection are answered.
+ */
+struct jrpc_job {
+	struct jrpc_job *next;		/* in connection order */
+	struct jrpc_job *queue_next;	/* pool queue, then completed list */
+	struct jrpc_connection *conn;
+	struct jrpc_procedure *procedure;	/* NULL for held responses */
+	struct jrpc_context ctx;
+	struct json *params, *id, *result;
+	struct json_arena arena;	/* owns the request */
+	int holds;			/* async: the handler, the answer */
+	int code;			/* async: jrpc_fail()'s error */
+	char *message;
+	char *data;			/* held response */
+	size_t len;
+	int done;
+	/* batches: answers of the elements, in order */
+	struct jrpc_job *batch;		/* the batch an element belongs to */
+	struct jrpc_job *children, *children_tail;
+	int pending;			/* pooled elements not answered yet */
+};
+
+struct jrpc_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct jrpc_job *head, *tail;
+	pthread_t *threads;
+	int size, started, stopping;
+};
+
+/* stop reading from a connection with this many pooled/async requests
+ * pending */
+#define JRPC_POOL_CONNECTION_MAX 64
+
+struct jrpc_worker {
+	struct jrpc_server *server;
 	struct ev_loop *loop;
 	ev_io listen_watcher;
+	ev_async stop_watcher;
+	ev_async done_watcher;
+	pthread_mutex_t done_lock;
+	struct jrpc_job *done;		/* completed by the pool */
+	pthread_t thread;
+	int running;
+	struct jrpc_lookup_stats lookup_stats;
+};
+
+struct jrpc_server {
+	char *addr;
+	struct ev_loop *loop;	/* worker 0's loop */
+	int worker_count;
+	struct jrpc_worker *workers;
 	int procedure_count;
-	struct jrpc_procedure *procedures;
+	unsigned int procedure_slots;	/* power of two, at most half full */
+	struct jrpc_procedure **procedures;
+	struct jrpc_lookup_stats lookup_stats;
+	struct jrpc_pool pool;
 	int debug_level;
 };
 
+/*
+ * Responses are queued per connection and written as the socket accepts
+ * them. Reading from a peer stops while more than the high watermark is
+ * pending and resumes once it drains below the low one.
+ */
+#define JRPC_OUTPUT_CHUNK 16384
+#define JRPC_OUTPUT_HIGH_WATERMARK (1024 * 1024)
+#define JRPC_OUTPUT_LOW_WATERMARK (256 * 1024)
+
+struct jrpc_output {
+	struct jrpc_output *next;
+	size_t off, len, size;
+	char data[];
+};
+
 struct jrpc_connection {
 	struct ev_io io;
+	struct ev_io write_io;
 	int fd;
 	int pos;
 	unsigned int buffer_size;
 	char *buffer;
+	struct json_parser parser;
+	struct json_arena arena;	/* requests are parsed and answered in it */
+	struct json_buffer wbuf;	/* messages are rendered here */
+	struct jrpc_output *out_head, *out_tail;
+	size_t out_len;		/* bytes pending in the output chain */
+	int closing;
 	int debug_level;
+	struct jrpc_worker *worker;	/* serving it, NULL on clients */
+	struct jrpc_job *jobs_head, *jobs_tail;
+	int pooled;		/* pooled/async requests not answered yet */
+	int draining;
+	int dead;		/* closed, freed once the pool is done with it */
+	int batch;		/* answering the elements of a batch */
+	struct json_buffer bbuf;	/* the batch's answers, when all inline */
+	struct jrpc_job *batch_job;	/* the batch, once an element is pooled */
+	struct jrpc_job *capture;	/* takes the next rendered message */
 };
 
 int jrpc_server_init(struct jrpc_server *server, char *addr);
+/* workers <= 0 starts one per online CPU */
+int jrpc_server_init_workers(struct jrpc_server *server, char *addr,
+			     int workers);
 int jrpc_server_init_with_ev_loop(struct jrpc_server *server,
 				  char *addr, struct ev_loop *loop);
+/* handler threads for JRPC_PROCEDURE_POOL, started by jrpc_server_run() */
+int jrpc_server_set_pool(struct jrpc_server *server, int threads);
 void jrpc_server_run(struct jrpc_server *server);
 int jrpc_server_stop(struct jrpc_server *server);
 void jrpc_server_destroy(struct jrpc_server *server);
 int jrpc_register_procedure(struct jrpc_server *server,
 			    jrpc_function function_pointer, char *name,
 			    void *data);
+int jrpc_register_procedure_flags(struct jrpc_server *server,
+				  jrpc_function function_pointer, char *name,
+				  void *data, int flags);
+/*
+ * Streaming procedures get their params as events, and the server never
+ * builds them: the callbacks are handed the request's jrpc_context as ctx
+ * and may keep what they gather in ctx->state, e.g. allocated from
+ * ctx->arena.  The function answers the call after the last event, with
+ * params still unparsed.  It also runs when streaming failed, with
+ * ctx->error_code set, to clean up only.
+ */
+int jrpc_register_stream_procedure(struct jrpc_server *server,
+				   const struct json_events *events,
+				   jrpc_function function_pointer, char *name,
+				   void *data, int flags);
 int jrpc_deregister_procedure(struct jrpc_server *server, char *name);
+/* answer a pending JRPC_PROCEDURE_ASYNC call with result (consumed), or
+ * with an error; the token is gone afterwards */
+void jrpc_complete(struct jrpc_job *token, struct json *result);
+void jrpc_fail(struct jrpc_job *token, int code, const char *message);
+struct jrpc_procedure *jrpc_find_procedure(struct jrpc_server *server,
+					   const char *name);
+void jrpc_server_lookup_stats(struct jrpc_server *server,
+			      struct jrpc_lookup_stats *stats);
 
 /* jsonrpc client */
+struct jrpc_client;
+
+/*
+ * Calls go out as they are made, any number of them may be waiting for
+ * their answer on the connection, and each answer is handed to the
+ * callback of its call by id, in whatever order they come.  response is
+ * the whole response object (with "result" or "error"), deleted once the
+ * callback returns: detach what you keep.  It is NULL when the call failed
+ * without an answer, client->error says why.  Callbacks run from the loop
+ * given to jrpc_client_start(), or from a blocking call waiting for its
+ * own answer; they may make new calls but must not close the client.
+ */
+typedef void (*jrpc_callback) (struct jrpc_client *client,
+			       struct json *response, void *data);
+
+struct jrpc_call {
+	jrpc_callback callback;
+	void *data;
+	int id;
+	int used;
+};
+
 struct jrpc_client {
 	char *addr;
 	int debug_level;
-	int id;
+	int id;			/* of the next call */
 	struct jrpc_connection conn;
+	/* calls waiting for their answer, in slot id & (call_slots - 1) */
+	struct jrpc_call *calls;
+	unsigned int call_slots;
+	int pending;
+	struct ev_loop *loop;
+	int error;		/* the connection failed: -errno */
+	/* called once the connection fails, before its calls are failed */
+	void (*failed) (struct jrpc_client *client);
 };
 
 void jrpc_client_close(struct jrpc_client *client);
 int jrpc_client_init(struct jrpc_client *client, char *addr);
+/* read and write on loop from now on, without blocking */
+int jrpc_client_start(struct jrpc_client *client, struct ev_loop *loop);
+/* send a call, callback gets its answer; params are consumed */
+int jrpc_client_call_async(struct jrpc_client *client, const char *method,
+			   struct json *params, jrpc_callback callback,
+			   void *data);
+/* send a call and wait for its answer, *response gets its result */
 int jrpc_client_call(struct jrpc_client *client, const char *method,
 		struct json *params, struct json **response);
+/* send a notification, it is not answered; params are consumed like in
+ * jrpc_client_call() */
+int jrpc_client_notify(struct jrpc_client *client, const char *method,
+		       struct json *params);
+
+/*
+ * A call prepared once and made any number of times: the start of its
+ * request is rendered here, so a call only renders params and the id into
+ * the connection's buffers, with nothing allocated once those have grown
+ * to fit.  params are not consumed, the same ones can be changed in place
+ * and sent again.
+ */
+struct jrpc_prepared_call {
+	char *prefix;		/* {"method":"name" */
+	size_t prefix_len;
+};
+
+int jrpc_client_prepare(struct jrpc_prepared_call *call, const char *method);
+void jrpc_prepared_call_free(struct jrpc_prepared_call *call);
+int jrpc_client_call_prepared(struct jrpc_client *client,
+			      const struct jrpc_prepared_call *call,
+			      struct json *params, jrpc_callback callback,
+			      void *data);
+
+/*
+ * A client over several servers: per_endpoint connections to each, made
+ * without blocking on loop.  A call goes to the connection with the
+ * fewest calls waiting (JRPC_CLIENT_POOL_LEAST) or to the less busy of
+ * two picked at random (JRPC_CLIENT_POOL_P2C).  Failed connections are
+ * made again in the background.  An endpoint whose connections fail
+ * max_failures times in a row, without answering anything, gets no calls
+ * until it is retried, waiting twice as long after every further failure.
+ */
+#define JRPC_CLIENT_POOL_LEAST		0
+#define JRPC_CLIENT_POOL_P2C		1
+
+#define JRPC_CLIENT_POOL_MAX_FAILURES	3
+#define JRPC_CLIENT_POOL_RETRY		0.5	/* seconds */
+#define JRPC_CLIENT_POOL_RETRY_MAX	30.0
+
+struct jrpc_client_endpoint {
+	char *addr;
+	struct addrinfo *info;
+	int failures;		/* in a row */
+	ev_tstamp ejected_until;
+};
+
+struct jrpc_pooled_client {
+	struct jrpc_client client;
+	struct jrpc_client_pool *pool;
+	struct jrpc_client_endpoint *endpoint;
+	int state;		/* down, connecting or up */
+	int first_id;		/* of the calls on this connection */
+	ev_tstamp retry_at;
+};
+
+struct jrpc_client_pool {
+	struct ev_loop *loop;
+	struct jrpc_client_endpoint *endpoints;
+	int endpoint_count;
+	struct jrpc_pooled_client *clients;
+	int client_count;
+	int policy;
+	int max_failures;	/* JRPC_CLIENT_POOL_MAX_FAILURES */
+	ev_tstamp retry;	/* JRPC_CLIENT_POOL_RETRY */
+	struct ev_timer retry_timer;
+	unsigned int next;
+	unsigned int seed;
+};
+
+int jrpc_client_pool_init(struct jrpc_client_pool *pool,
+			  struct ev_loop *loop, char **addrs, int count,
+			  int per_endpoint, int policy);
+/* like jrpc_client_call_async(), on the connection the policy picks */
+int jrpc_client_pool_call_async(struct jrpc_client_pool *pool,
+				const char *method, struct json *params,
+				jrpc_callback callback, void *data);
+int jrpc_client_pool_call_prepared(struct jrpc_client_pool *pool,
+				   const struct jrpc_prepared_call *call,
+				   struct json *params,
+				   jrpc_callback callback, void *data);
+void jrpc_client_pool_close(struct jrpc_client_pool *pool);
 
 #endif
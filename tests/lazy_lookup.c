@@ -0,0 +1,64 @@
+/*
+ * Copyright 2016 Xiaomi Corporation. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+/*
+ * Looking a member up in lazy params big enough to be hashed expands
+ * them first, and finds the member through the index that came with them.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "json.h"
+
+#define MEMBERS 40
+
+int main(void)
+{
+	struct json_parser p;
+	struct json_arena arena;
+	struct json *root, *params, *item;
+	char buf[2048];
+	int i, n, ret = 0;
+
+	n = sprintf(buf, "{\"method\":\"m\",\"params\":{");
+	for (i = 0; i < MEMBERS; i++)
+		n += sprintf(buf + n, "%s\"k%d\":%d", i ? "," : "", i, i);
+	n += sprintf(buf + n, "},\"id\":1}");
+
+	json_arena_init(&arena, 0);
+	json_parser_init(&p);
+	p.arena = &arena;
+	p.insitu = 1;
+	p.lazy = "params";
+	if (json_parser_finish(&p, buf, n) != JSON_PARSE_DONE) {
+		fprintf(stderr, "parse error\n");
+		return 1;
+	}
+	root = json_parser_result(&p);
+	params = json_get_object_item(root, "params");
+	if (params == NULL || !(params->flags & JSON_F_LAZY)) {
+		fprintf(stderr, "params are not lazy\n");
+		return 1;
+	}
+	for (i = MEMBERS - 1; i >= 0; i--) {
+		char name[16];
+
+		sprintf(name, "K%d", i);
+		item = json_get_object_item(params, name);
+		if (item == NULL || item->valueint != i) {
+			fprintf(stderr, "%s: not found\n", name);
+			ret = 1;
+		}
+	}
+	if (json_get_object_item(params, "k40")
+	    || json_get_array_size(params) != MEMBERS) {
+		fprintf(stderr, "wrong members\n");
+		ret = 1;
+	}
+	json_delete(root);
+	json_parser_destroy(&p);
+	json_arena_destroy(&arena);
+	return ret;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2016 Xiaomi Corporation. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+/*
+ * Trailing commas and malformed escapes are rejected, whether the text
+ * comes in at once or a byte at a time.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "json.h"
+
+static const char *bad[] = {
+	"[1,]", "[1,\n]", "{\"a\":1,}", "{\"a\":1 , }", "[,]", "{,}",
+	"[1,,2]", "\"a\\u12\"", "\"\\uZZZZx\"", "\"\\u12G4\"", "\"\\q\"",
+	"[\"\\x41\"]", "{\"k\\u00\":1}",
+};
+
+static const char *good[] = {
+	"[]", "{}", "[1, 2]", "{\"a\":1, \"b\":[true,null]}",
+	"\"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u00e9\\uD83D\\uDE00\"", "[\"\\uABCDx\"]",
+};
+
+/* JSON_PARSE_DONE or JSON_PARSE_ERROR, fed in pieces of step bytes */
+static int parse(const char *text, size_t step)
+{
+	struct json_parser p;
+	size_t len = strlen(text), n;
+	int ret = JSON_PARSE_MORE;
+
+	json_parser_init(&p);
+	for (n = step; n < len && ret == JSON_PARSE_MORE; n += step)
+		ret = json_parser_feed(&p, text, n);
+	if (ret == JSON_PARSE_MORE)
+		ret = json_parser_finish(&p, text, len);
+	if (ret == JSON_PARSE_DONE)
+		json_delete(json_parser_result(&p));
+	json_parser_destroy(&p);
+	return ret;
+}
+
+int main(void)
+{
+	int i, ret = 0;
+	size_t step;
+
+	for (step = 1; step <= 64; step *= 64) {
+		for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+			if (parse(bad[i], step) != JSON_PARSE_ERROR) {
+				fprintf(stderr, "accepted: %s\n", bad[i]);
+				ret = 1;
+			}
+		for (i = 0; i < sizeof(good) / sizeof(good[0]); i++)
+			if (parse(good[i], step) != JSON_PARSE_DONE) {
+				fprintf(stderr, "rejected: %s\n", good[i]);
+				ret = 1;
+			}
+	}
+	return ret;
+}